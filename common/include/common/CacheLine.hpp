@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Common {
+
+/**
+ * Assumed size of a cache line in bytes.
+ *
+ * Used to align data written by different threads to separate cache lines
+ * to avoid false sharing. std::hardware_destructive_interference_size is
+ * not used as its value may differ between compilation units.
+ */
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+} // namespace Common
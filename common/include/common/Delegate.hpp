@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+
+namespace Common {
+
+template <typename Signature>
+class Delegate;
+
+/**
+ * Callable bound to an object and its member function, or to a free function.
+ *
+ * Unlike std::function, the target is stored in place and never allocated, and calling
+ * the delegate makes one indirect call to a stub, which calls the target directly.
+ * The delegate is trivially copyable and does not own the object.
+ *
+ * The target may take all of @p Args, by reference or by value, or no parameters at all.
+ * Its return value is ignored.
+ *
+ * Example:
+ *
+ *   auto delegate = Delegate<void(const Data&)>::fromMember(view, &View::update);
+ *   delegate(data); // Calls view.update(data)
+ *
+ * @tparam Args Parameters of the call
+ */
+template <typename... Args>
+class Delegate<void(Args...)>
+{
+public:
+    /** @return Delegate calling @p method of @p object */
+    template <typename Object, typename Interface, typename Return, typename... Params>
+    static Delegate fromMember(Object& object, Return (Interface::*method)(Params...));
+
+    /** @return Delegate calling @p function */
+    template <typename Return, typename... Params>
+    static Delegate fromFunction(Return (*function)(Params...));
+
+    /** Call the target */
+    void operator()(Args... args) const { stub_(*this, args...); }
+
+private:
+    class Undefined;
+
+    /** Largest member function pointer, of a class with unknown inheritance */
+    using MemberPointer = void (Undefined::*)();
+
+    using Stub = void (*)(const Delegate& delegate, Args... args);
+
+    Delegate(void* object, Stub stub);
+
+    /** Store @p target, a member function or free function pointer */
+    template <typename Target>
+    void setTarget(Target target);
+
+    /** @return Stored target of type @p Target */
+    template <typename Target>
+    Target getTarget() const;
+
+    /** Call @p call with all or none of the arguments, as @p Params requires */
+    template <typename... Params, typename Call>
+    static void callWith(Call call, Args... args);
+
+    template <typename Object, typename Method, typename... Params>
+    static void callMember(const Delegate& delegate, Args... args);
+
+    template <typename Function, typename... Params>
+    static void callFunction(const Delegate& delegate, Args... args);
+
+    void* object_;
+    Stub stub_;
+    alignas(MemberPointer) unsigned char target_[sizeof(MemberPointer)];
+};
+
+template <typename... Args>
+Delegate<void(Args...)>::Delegate(void* object, Stub stub) : object_{object}, stub_{stub}, target_{}
+{
+}
+
+template <typename... Args>
+template <typename Object, typename Interface, typename Return, typename... Params>
+Delegate<void(Args...)> Delegate<void(Args...)>::fromMember(Object& object, Return (Interface::*method)(Params...))
+{
+    using Method = Return (Interface::*)(Params...);
+
+    Delegate delegate{&object, &callMember<Object, Method, Params...>};
+    delegate.setTarget(method);
+    return delegate;
+}
+
+template <typename... Args>
+template <typename Return, typename... Params>
+Delegate<void(Args...)> Delegate<void(Args...)>::fromFunction(Return (*function)(Params...))
+{
+    using Function = Return (*)(Params...);
+
+    Delegate delegate{nullptr, &callFunction<Function, Params...>};
+    delegate.setTarget(function);
+    return delegate;
+}
+
+template <typename... Args>
+template <typename Target>
+void Delegate<void(Args...)>::setTarget(Target target)
+{
+    static_assert(sizeof(Target) <= sizeof(target_), "Target does not fit in place");
+    std::memcpy(target_, &target, sizeof(Target));
+}
+
+template <typename... Args>
+template <typename Target>
+Target Delegate<void(Args...)>::getTarget() const
+{
+    Target target;
+    std::memcpy(&target, target_, sizeof(Target));
+    return target;
+}
+
+template <typename... Args>
+template <typename... Params, typename Call>
+void Delegate<void(Args...)>::callWith(Call call, Args... args)
+{
+    static_assert(sizeof...(Params) == 0 || sizeof...(Params) == sizeof...(Args),
+                  "Target needs to take all or none of the arguments");
+
+    if constexpr (sizeof...(Params) == 0)
+        call();
+    else
+        call(args...);
+}
+
+template <typename... Args>
+template <typename Object, typename Method, typename... Params>
+void Delegate<void(Args...)>::callMember(const Delegate& delegate, Args... args)
+{
+    Object& object = *static_cast<Object*>(delegate.object_);
+    const Method method = delegate.getTarget<Method>();
+
+    callWith<Params...>([&](auto&&... params) { (object.*method)(params...); }, args...);
+}
+
+template <typename... Args>
+template <typename Function, typename... Params>
+void Delegate<void(Args...)>::callFunction(const Delegate& delegate, Args... args)
+{
+    const Function function = delegate.getTarget<Function>();
+
+    callWith<Params...>([&](auto&&... params) { function(params...); }, args...);
+}
+
+} // namespace Common
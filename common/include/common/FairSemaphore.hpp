@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace Common {
+
+/**
+ * Semaphore granting resources to waiters in the order they started waiting.
+ *
+ * Has the same interface as Common::Semaphore. Each waiter is queued with the number of resources
+ * it needs, and notify hands resources to the oldest waiters as soon as there are enough for them.
+ * A waiter needing many resources is thus not starved by waiters needing few, and no waiter keeps
+ * sleeping while there are enough resources for it and nobody is queued before it.
+ *
+ * Slower than Common::Semaphore, as every operation takes a lock. Use when several threads
+ * wait for differing counts.
+ */
+class FairSemaphore
+{
+public:
+    /** Initialize with @p count resources */
+    explicit FairSemaphore(size_t count = 0);
+
+    /** Prevent copy, assignment and move */
+    FairSemaphore(const FairSemaphore&) = delete;
+    FairSemaphore& operator=(const FairSemaphore&) = delete;
+    FairSemaphore& operator=(FairSemaphore&&) = delete;
+
+    /** Notify @p count resources */
+    void notify(size_t count = 1);
+
+    /** Block to wait for @p count resources*/
+    void wait(size_t count = 1);
+
+    /**
+     * Try to get @p count resources. Fails also if there are other waiters queued.
+     * @return True if resources were acquired, false otherwise
+     */
+    bool tryWait(size_t count = 1);
+
+    /**
+     * Block to wait for at least one resource and get up to @p maxCount resources
+     * @return Number of resources acquired, zero without waiting if @p maxCount is zero
+     */
+    size_t waitUpTo(size_t maxCount);
+
+    /**
+     * Try to get up to @p maxCount resources. Fails also if there are other waiters queued.
+     * @return Number of resources acquired, zero if there were none
+     */
+    size_t tryWaitUpTo(size_t maxCount);
+
+    /** Block to wait for a @p duration for @p count resources */
+    template <class Rep, class Period>
+    bool waitFor(const std::chrono::duration<Rep, Period>& duration, size_t count = 1);
+
+    /** Block to wait until a @p timePoint for @p count resources */
+    template <class Clock, class Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& timePoint, size_t count = 1);
+
+    /** @return current resources count */
+    size_t getCount() const;
+
+    /** @return Number of threads waiting for resources */
+    size_t getWaiterCount() const;
+
+private:
+    using WaitLock = std::unique_lock<std::mutex>;
+
+    /** Queued waiter, lives on the stack of the waiting thread */
+    struct Waiter
+    {
+        Waiter(size_t minCount, size_t maxCount);
+
+        size_t minCount_;
+        size_t maxCount_;
+        size_t granted_; ///< Resources handed to the waiter, zero until granted
+        std::condition_variable condition_;
+        Waiter* next_;
+    };
+
+    size_t count_;
+    size_t waiterCount_;
+    Waiter* firstWaiter_;
+    Waiter* lastWaiter_;
+    mutable std::mutex mutex_;
+
+    /** Take up to @p maxCount resources without waiting, if no one is queued. Needs lock. */
+    size_t tryAcquire(size_t minCount, size_t maxCount);
+
+    /**
+     * Take resources right away or queue up and @p sleep until granted.
+     * @return Granted resources, zero if @p sleep returned false before that
+     */
+    template <typename Sleep>
+    size_t acquire(WaitLock& lock, size_t minCount, size_t maxCount, Sleep sleep);
+
+    /** Sleep function for acquire, never giving up */
+    static bool sleepUntilNotified(WaitLock& lock, std::condition_variable& condition);
+
+    /** Hand resources to the waiters in order, as long as there's enough for the first one. Needs lock. */
+    void grantWaiters();
+
+    /** Queue management, needs lock */
+    ///@{
+    void pushWaiter(Waiter& waiter);
+    void removeWaiter(Waiter& waiter);
+    ///@}
+};
+
+inline FairSemaphore::Waiter::Waiter(size_t minCount, size_t maxCount)
+  : minCount_{minCount}, maxCount_{maxCount}, granted_{0}, condition_{}, next_{nullptr}
+{
+}
+
+inline FairSemaphore::FairSemaphore(size_t count)
+  : count_{count}, waiterCount_{0}, firstWaiter_{nullptr}, lastWaiter_{nullptr}, mutex_{}
+{
+}
+
+inline void FairSemaphore::notify(size_t count)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    count_ += count;
+    grantWaiters();
+}
+
+inline void FairSemaphore::wait(size_t count)
+{
+    WaitLock lock{mutex_};
+    (void)acquire(lock, count, count, sleepUntilNotified);
+}
+
+inline bool FairSemaphore::tryWait(size_t count)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return tryAcquire(count, count) == count;
+}
+
+inline size_t FairSemaphore::waitUpTo(size_t maxCount)
+{
+    if (maxCount == 0)
+        return 0;
+
+    WaitLock lock{mutex_};
+    return acquire(lock, 1, maxCount, sleepUntilNotified);
+}
+
+inline size_t FairSemaphore::tryWaitUpTo(size_t maxCount)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return tryAcquire(1, maxCount);
+}
+
+template <class Rep, class Period>
+bool FairSemaphore::waitFor(const std::chrono::duration<Rep, Period>& duration, size_t count)
+{
+    return waitUntil(std::chrono::steady_clock::now() + duration, count);
+}
+
+template <class Clock, class Duration>
+bool FairSemaphore::waitUntil(const std::chrono::time_point<Clock, Duration>& timePoint, size_t count)
+{
+    const auto sleepUntilTimePoint = [&timePoint](WaitLock& lock, std::condition_variable& condition) {
+        return condition.wait_until(lock, timePoint) == std::cv_status::no_timeout;
+    };
+
+    WaitLock lock{mutex_};
+    const size_t acquired = acquire(lock, count, count, sleepUntilTimePoint);
+
+    return acquired == count;
+}
+
+inline size_t FairSemaphore::getCount() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return count_;
+}
+
+inline size_t FairSemaphore::getWaiterCount() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return waiterCount_;
+}
+
+inline size_t FairSemaphore::tryAcquire(size_t minCount, size_t maxCount)
+{
+    if (firstWaiter_ || count_ < minCount)
+        return 0;
+
+    const size_t acquired = std::min(count_, maxCount);
+    count_ -= acquired;
+    return acquired;
+}
+
+template <typename Sleep>
+size_t FairSemaphore::acquire(WaitLock& lock, size_t minCount, size_t maxCount, Sleep sleep)
+{
+    if (minCount == 0 || (!firstWaiter_ && count_ >= minCount))
+        return tryAcquire(minCount, maxCount);
+
+    Waiter waiter{minCount, maxCount};
+    pushWaiter(waiter);
+
+    while (waiter.granted_ == 0)
+    {
+        if (!sleep(lock, waiter.condition_))
+        {
+            if (waiter.granted_ != 0)
+                break;
+
+            // Gave up, waiters after us may be able to continue now
+            removeWaiter(waiter);
+            grantWaiters();
+            return 0;
+        }
+    }
+
+    return waiter.granted_;
+}
+
+inline bool FairSemaphore::sleepUntilNotified(WaitLock& lock, std::condition_variable& condition)
+{
+    condition.wait(lock);
+    return true;
+}
+
+inline void FairSemaphore::grantWaiters()
+{
+    while (firstWaiter_ && count_ >= firstWaiter_->minCount_)
+    {
+        Waiter& waiter = *firstWaiter_;
+        removeWaiter(waiter);
+
+        waiter.granted_ = std::min(count_, waiter.maxCount_);
+        count_ -= waiter.granted_;
+        waiter.condition_.notify_one();
+    }
+}
+
+inline void FairSemaphore::pushWaiter(Waiter& waiter)
+{
+    if (lastWaiter_)
+        lastWaiter_->next_ = &waiter;
+    else
+        firstWaiter_ = &waiter;
+
+    lastWaiter_ = &waiter;
+    ++waiterCount_;
+}
+
+inline void FairSemaphore::removeWaiter(Waiter& waiter)
+{
+    Waiter* previous = nullptr;
+    for (Waiter* current = firstWaiter_; current != &waiter; current = current->next_)
+    {
+        previous = current;
+    }
+
+    (previous ? previous->next_ : firstWaiter_) = waiter.next_;
+    if (lastWaiter_ == &waiter)
+        lastWaiter_ = previous;
+
+    waiter.next_ = nullptr;
+    --waiterCount_;
+}
+
+} // namespace Common
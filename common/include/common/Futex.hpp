@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace Common {
+
+/**
+ * A 32-bit value threads can sleep on until it changes.
+ *
+ * Uses the Linux futex system call, so sleeping and waking up take no locks in user space.
+ * Elsewhere falls back to a mutex and a condition variable.
+ *
+ * Waits may return spuriously, so callers check their actual condition in a loop.
+ * Change the value before waking up the waiters.
+ */
+class Futex
+{
+public:
+    explicit Futex(uint32_t value = 0);
+
+    /** Prevent copy, assignment and move */
+    Futex(const Futex&) = delete;
+    Futex& operator=(const Futex&) = delete;
+    Futex& operator=(Futex&&) = delete;
+
+    /** Access the value */
+    ///@{
+    uint32_t load() const;
+    void store(uint32_t value);
+    uint32_t exchange(uint32_t value);
+    uint32_t fetchAdd(uint32_t value);
+    ///@}
+
+    /** Block while the value is @p expected */
+    void wait(uint32_t expected);
+
+    /** Block while the value is @p expected, at most for @p timeout */
+    void waitFor(uint32_t expected, std::chrono::nanoseconds timeout);
+
+    /** Wake up all waiting threads */
+    void wakeAll();
+
+private:
+    std::atomic<uint32_t> value_;
+
+#if defined(__linux__)
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex needs a plain 32-bit word");
+
+    uint32_t* address() { return reinterpret_cast<uint32_t*>(&value_); }
+#else
+    std::mutex mutex_;
+    std::condition_variable condition_;
+#endif
+};
+
+inline Futex::Futex(uint32_t value) : value_{value} {}
+
+inline uint32_t Futex::load() const
+{
+    return value_.load(std::memory_order_seq_cst);
+}
+
+inline void Futex::store(uint32_t value)
+{
+    value_.store(value, std::memory_order_seq_cst);
+}
+
+inline uint32_t Futex::exchange(uint32_t value)
+{
+    return value_.exchange(value, std::memory_order_seq_cst);
+}
+
+inline uint32_t Futex::fetchAdd(uint32_t value)
+{
+    return value_.fetch_add(value, std::memory_order_seq_cst);
+}
+
+#if defined(__linux__)
+
+inline void Futex::wait(uint32_t expected)
+{
+    (void)syscall(SYS_futex, address(), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+inline void Futex::waitFor(uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+    const timespec relativeTimeout{
+        static_cast<time_t>(seconds.count()), static_cast<long>((timeout - seconds).count())};
+
+    (void)syscall(SYS_futex, address(), FUTEX_WAIT_PRIVATE, expected, &relativeTimeout, nullptr, 0);
+}
+
+inline void Futex::wakeAll()
+{
+    (void)syscall(SYS_futex, address(), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+inline void Futex::wait(uint32_t expected)
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    condition_.wait(lock, [&] { return load() != expected; });
+}
+
+inline void Futex::waitFor(uint32_t expected, std::chrono::nanoseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    (void)condition_.wait_for(lock, timeout, [&] { return load() != expected; });
+}
+
+inline void Futex::wakeAll()
+{
+    {
+        // Waiter is either not yet checking the value or already waiting
+        std::lock_guard<std::mutex> lock{mutex_};
+    }
+    condition_.notify_all();
+}
+
+#endif
+
+} // namespace Common
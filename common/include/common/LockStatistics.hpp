@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Common {
+
+/**
+ * Lock contention statistics.
+ *
+ * Instrumented locks and semaphores count their acquisitions into a LockCounters object. Named counters
+ * are listed in the LockStatisticsRegistry, which can be dumped to find out which instance is the bottleneck.
+ *
+ * Recording is enabled at compile time by defining LL_TOOLKIT_LOCK_STATISTICS, see the CMake option with
+ * the same name. Otherwise LockCounters records nothing, and the registry stays empty.
+ *
+ * The layout of LockCounters, and of the classes containing it, depends on the setting, and so does what
+ * the registry reports. They are declared in the inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE,
+ * so code built with different settings fails to link together instead of disagreeing on the layout.
+ */
+///@{
+
+#if defined(LL_TOOLKIT_LOCK_STATISTICS)
+#define LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE LockStatisticsEnabled
+#else
+#define LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE LockStatisticsDisabled
+#endif
+
+/** Statistics of a single named instance */
+struct LockStatistics
+{
+    std::string name_;
+    uint64_t acquisitions_ = 0;
+    uint64_t contendedAcquisitions_ = 0;      ///< Acquisitions which had to wait
+    std::chrono::nanoseconds totalWaitTime_{}; ///< Time spent waiting in the contended acquisitions
+    std::chrono::nanoseconds maxHoldTime_{};   ///< Longest time held, zero where holding is not tracked
+};
+
+inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE {
+
+class LockCounters;
+
+/** Registry of all named LockCounters */
+class LockStatisticsRegistry
+{
+public:
+    /** @return The process wide registry */
+    static LockStatisticsRegistry& instance();
+
+    /** Prevent copy, assignment and move */
+    LockStatisticsRegistry(const LockStatisticsRegistry&) = delete;
+    LockStatisticsRegistry& operator=(const LockStatisticsRegistry&) = delete;
+    LockStatisticsRegistry& operator=(LockStatisticsRegistry&&) = delete;
+
+    /** @return Current statistics of all registered instances */
+    std::vector<LockStatistics> getStatistics() const;
+
+    /** Write the current statistics to @p stream, one line per instance */
+    void dump(std::ostream& stream) const;
+
+private:
+    friend class LockCounters;
+
+    LockStatisticsRegistry() = default;
+
+    void add(const LockCounters* counters);
+    void remove(const LockCounters* counters);
+
+    mutable std::mutex mutex_;
+    std::vector<const LockCounters*> counters_;
+};
+
+} // namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE
+
+#if defined(LL_TOOLKIT_LOCK_STATISTICS)
+
+inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE {
+
+/** Counters of a single instance, registered while it has a name */
+class LockCounters
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr bool ENABLED = true;
+
+    LockCounters();
+    explicit LockCounters(std::string name);
+    LockCounters(LockCounters&& other);
+    ~LockCounters();
+
+    /** Prevent copy and assignment */
+    LockCounters(const LockCounters&) = delete;
+    LockCounters& operator=(const LockCounters&) = delete;
+    LockCounters& operator=(LockCounters&&) = delete;
+
+    /** Name the instance in the registry, an empty name removes it from there */
+    void setName(std::string name);
+
+    /** @return Current time for the record functions */
+    Clock::time_point now() const { return Clock::now(); }
+
+    /** Record an acquisition which didn't have to wait */
+    void recordAcquisition();
+
+    /** Record an acquisition which had to wait since @p waitStart */
+    void recordContendedAcquisition(Clock::time_point waitStart);
+
+    /** Record a release of a hold started at @p holdStart */
+    void recordRelease(Clock::time_point holdStart);
+
+    /** @return Current statistics */
+    LockStatistics getStatistics() const;
+
+private:
+    std::string name_; ///< Changed only by the owner, before or after using the lock
+    std::atomic<uint64_t> acquisitions_;
+    std::atomic<uint64_t> contendedAcquisitions_;
+    std::atomic<int64_t> totalWaitNanoseconds_;
+    std::atomic<int64_t> maxHoldNanoseconds_;
+};
+
+} // namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE
+
+inline LockCounters::LockCounters()
+  : name_(), acquisitions_{0}, contendedAcquisitions_{0}, totalWaitNanoseconds_{0}, maxHoldNanoseconds_{0}
+{
+}
+
+inline LockCounters::LockCounters(std::string name) : LockCounters()
+{
+    setName(std::move(name));
+}
+
+inline LockCounters::LockCounters(LockCounters&& other) : LockCounters()
+{
+    acquisitions_ = other.acquisitions_.load();
+    contendedAcquisitions_ = other.contendedAcquisitions_.load();
+    totalWaitNanoseconds_ = other.totalWaitNanoseconds_.load();
+    maxHoldNanoseconds_ = other.maxHoldNanoseconds_.load();
+
+    std::string name = other.name_;
+    other.setName({});
+    setName(std::move(name));
+}
+
+inline LockCounters::~LockCounters()
+{
+    setName({});
+}
+
+inline void LockCounters::setName(std::string name)
+{
+    if (!name_.empty())
+        LockStatisticsRegistry::instance().remove(this);
+
+    name_ = std::move(name);
+
+    if (!name_.empty())
+        LockStatisticsRegistry::instance().add(this);
+}
+
+inline void LockCounters::recordAcquisition()
+{
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void LockCounters::recordContendedAcquisition(Clock::time_point waitStart)
+{
+    const auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - waitStart);
+
+    acquisitions_.fetch_add(1, std::memory_order_relaxed);
+    contendedAcquisitions_.fetch_add(1, std::memory_order_relaxed);
+    totalWaitNanoseconds_.fetch_add(waited.count(), std::memory_order_relaxed);
+}
+
+inline void LockCounters::recordRelease(Clock::time_point holdStart)
+{
+    const int64_t held = std::chrono::duration_cast<std::chrono::nanoseconds>(now() - holdStart).count();
+
+    int64_t max = maxHoldNanoseconds_.load(std::memory_order_relaxed);
+    while (held > max && !maxHoldNanoseconds_.compare_exchange_weak(max, held, std::memory_order_relaxed))
+    {
+    }
+}
+
+inline LockStatistics LockCounters::getStatistics() const
+{
+    LockStatistics statistics;
+    statistics.name_ = name_;
+    statistics.acquisitions_ = acquisitions_.load(std::memory_order_relaxed);
+    statistics.contendedAcquisitions_ = contendedAcquisitions_.load(std::memory_order_relaxed);
+    statistics.totalWaitTime_ = std::chrono::nanoseconds(totalWaitNanoseconds_.load(std::memory_order_relaxed));
+    statistics.maxHoldTime_ = std::chrono::nanoseconds(maxHoldNanoseconds_.load(std::memory_order_relaxed));
+    return statistics;
+}
+
+#else
+
+inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE {
+
+/** Counters recording nothing, statistics are disabled */
+class LockCounters
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr bool ENABLED = false;
+
+    LockCounters() = default;
+    explicit LockCounters(const std::string&) {}
+
+    void setName(const std::string&) {}
+
+    Clock::time_point now() const { return {}; }
+
+    void recordAcquisition() {}
+    void recordContendedAcquisition(Clock::time_point) {}
+    void recordRelease(Clock::time_point) {}
+
+    LockStatistics getStatistics() const { return {}; }
+};
+
+} // namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE
+
+#endif
+
+// LockStatisticsRegistry implementation
+inline LockStatisticsRegistry& LockStatisticsRegistry::instance()
+{
+    static LockStatisticsRegistry registry;
+    return registry;
+}
+
+inline std::vector<LockStatistics> LockStatisticsRegistry::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    std::vector<LockStatistics> statistics;
+    statistics.reserve(counters_.size());
+    for (const LockCounters* counters : counters_)
+    {
+        statistics.push_back(counters->getStatistics());
+    }
+    return statistics;
+}
+
+inline void LockStatisticsRegistry::dump(std::ostream& stream) const
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    for (const LockStatistics& statistics : getStatistics())
+    {
+        stream << statistics.name_ << ": acquisitions " << statistics.acquisitions_ << ", contended "
+               << statistics.contendedAcquisitions_ << ", total wait "
+               << duration_cast<microseconds>(statistics.totalWaitTime_).count() << " us, max hold "
+               << duration_cast<microseconds>(statistics.maxHoldTime_).count() << " us" << std::endl;
+    }
+}
+
+inline void LockStatisticsRegistry::add(const LockCounters* counters)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    counters_.push_back(counters);
+}
+
+inline void LockStatisticsRegistry::remove(const LockCounters* counters)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    counters_.erase(std::remove(counters_.begin(), counters_.end(), counters), counters_.end());
+}
+
+///@}
+
+} // namespace Common
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace Common {
+
+/**
+ * Place for a thread to sleep while waiting for a condition changed by other threads.
+ *
+ * The waiting thread first polls the condition for a while and only then parks itself on
+ * a condition variable. Notifying is cheap when nobody is parked: a fence and a load, no locking.
+ *
+ * Any number of threads may notify, but only one thread may wait at a time.
+ *
+ * Example:
+ *
+ *   // Waiter
+ *   parking.wait([&] { return flag.load(std::memory_order_acquire); });
+ *
+ *   // Notifier
+ *   flag.store(true, std::memory_order_release);
+ *   parking.notify();
+ */
+class Parking
+{
+public:
+    /** Number of times a condition is polled before parking the thread */
+    static constexpr int SPIN_COUNT = 256;
+
+    Parking();
+
+    /** Prevent copy, assignment and move */
+    Parking(const Parking&) = delete;
+    Parking& operator=(const Parking&) = delete;
+    Parking& operator=(Parking&&) = delete;
+
+    /** Block until @p ready returns true */
+    template <typename Predicate>
+    void wait(Predicate ready);
+
+    /**
+     * Block until @p ready returns true or @p timePoint is reached
+     * @return Value of @p ready at return
+     */
+    template <typename Predicate, class Clock, class Duration>
+    bool waitUntil(Predicate ready, const std::chrono::time_point<Clock, Duration>& timePoint);
+
+    /** Wake up the parked thread, if any. Call after changing the state @p ready checks. */
+    void notify();
+
+private:
+    std::atomic<bool> waiting_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
+inline Parking::Parking() : waiting_{false}, mutex_{}, condition_{} {}
+
+template <typename Predicate>
+void Parking::wait(Predicate ready)
+{
+    for (int spin = 0; spin < SPIN_COUNT; ++spin)
+    {
+        if (ready())
+            return;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    waiting_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in notify: either we see the new state or the notifier sees us waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition_.wait(lock, ready);
+    waiting_.store(false, std::memory_order_relaxed);
+}
+
+template <typename Predicate, class Clock, class Duration>
+bool Parking::waitUntil(Predicate ready, const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    for (int spin = 0; spin < SPIN_COUNT; ++spin)
+    {
+        if (ready())
+            return true;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const bool finished = condition_.wait_until(lock, timePoint, ready);
+    waiting_.store(false, std::memory_order_relaxed);
+
+    return finished;
+}
+
+inline void Parking::notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        condition_.notify_one();
+    }
+}
+
+} // namespace Common
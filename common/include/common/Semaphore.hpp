@@ -1,15 +1,36 @@
 #pragma once
 
+#include "common/Futex.hpp"
+#include "common/LockStatistics.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <mutex>
+#include <cstdint>
+#include <string>
 
 namespace Common {
 
-/** Semaphore, an atomic counter. */
+// Layout depends on the lock statistics setting, see LockStatistics.hpp
+inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE {
+
+/**
+ * Semaphore, an atomic counter.
+ *
+ * Resources are acquired with a compare-and-swap on the counter. A waiting thread polls the counter
+ * for a while and only then sleeps on a Common::Futex. Notifying costs a system call only
+ * when some thread has stopped polling to sleep.
+ *
+ * Waiters are woken up together and compete for the resources, so a thread waiting for
+ * a big count may starve behind threads waiting for small counts. See FairSemaphore.
+ *
+ * Waits can be recorded in the LockStatisticsRegistry by naming the semaphore, see setName.
+ */
 class Semaphore
 {
 public:
+    /** Number of times the counter is polled before sleeping */
+    static constexpr int SPIN_COUNT = 256;
+
     /** Initialize with @p count resources */
     explicit Semaphore(size_t count = 0);
 
@@ -30,6 +51,18 @@ public:
      */
     bool tryWait(size_t count = 1);
 
+    /**
+     * Block to wait for at least one resource and get up to @p maxCount resources
+     * @return Number of resources acquired, zero without waiting if @p maxCount is zero
+     */
+    size_t waitUpTo(size_t maxCount);
+
+    /**
+     * Try to get up to @p maxCount resources
+     * @return Number of resources acquired, zero if there were none
+     */
+    size_t tryWaitUpTo(size_t maxCount);
+
     /** Block to wait for a @p duration for @p count resources */
     template <class Rep, class Period>
     bool waitFor(const std::chrono::duration<Rep, Period>& duration, size_t count = 1);
@@ -41,65 +74,197 @@ public:
     /** @return current resources count */
     size_t getCount() const;
 
+    /** Record the waits under @p name in the LockStatisticsRegistry. Call before using the semaphore. */
+    void setName(std::string name);
+
 private:
-    size_t count_;
-    mutable std::mutex mutex_;
-    std::condition_variable condition_;
+    std::atomic<size_t> count_;
+    std::atomic<uint32_t> sleeperCount_; ///< Threads done polling, sleeping or about to
+    Futex sequence_;                     ///< Changed by notify when there are sleepers, so none misses it
+    LockCounters counters_;
+
+    /** Take @p count resources if available */
+    bool tryAcquire(size_t count);
+
+    /** Take at least one and up to @p maxCount resources if available */
+    size_t tryAcquireUpTo(size_t maxCount);
+
+    /**
+     * Poll @p tryAcquire and sleep with @p sleep between polls until it succeeds
+     * or @p sleep returns false to give up. @p sleep gets the sequence_ value read before polling.
+     */
+    template <typename TryAcquire, typename Sleep>
+    bool acquireWith(TryAcquire tryAcquire, Sleep sleep);
+
+    /** Slow path of acquireWith, polling and sleeping */
+    template <typename TryAcquire, typename Sleep>
+    bool waitAndAcquireWith(TryAcquire tryAcquire, Sleep sleep);
+
+    /** Sleep function for acquireWith, giving up at @p timePoint */
+    template <class Clock, class Duration>
+    auto sleepUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+
+    /** Sleep function for acquireWith, never giving up */
+    auto sleepForever();
 };
 
-inline Semaphore::Semaphore(size_t count) : count_{count} {}
+} // namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE
+
+inline Semaphore::Semaphore(size_t count) : count_{count}, sleeperCount_{0}, sequence_{0}, counters_{} {}
+
+inline auto Semaphore::sleepForever()
+{
+    return [this](uint32_t sequence) {
+        sequence_.wait(sequence);
+        return true;
+    };
+}
 
 inline void Semaphore::notify(size_t count)
 {
+    count_.fetch_add(count, std::memory_order_seq_cst);
+
+    // Pairs with waitAndAcquireWith: either the sleeper sees the new count or we see the sleeper.
+    // Each notification changes the sequence, so a sleeper that polled before it can't sleep through it.
+    if (sleeperCount_.load(std::memory_order_seq_cst) != 0)
     {
-        std::lock_guard<std::mutex> lock{mutex_};
-        count_ += count;
+        (void)sequence_.fetchAdd(1);
+        sequence_.wakeAll();
     }
-    condition_.notify_one();
 }
 
 inline void Semaphore::wait(size_t count)
 {
-    std::unique_lock<std::mutex> lock{mutex_};
-    condition_.wait(lock, [&] { return count_ >= count; });
-    count_ -= count;
+    (void)acquireWith([&] { return tryAcquire(count); }, sleepForever());
 }
 
 inline bool Semaphore::tryWait(size_t count)
 {
-    return waitFor(std::chrono::nanoseconds::zero(), count);
+    return tryAcquire(count);
+}
+
+inline size_t Semaphore::waitUpTo(size_t maxCount)
+{
+    if (maxCount == 0)
+        return 0;
+
+    size_t acquired = 0;
+    (void)acquireWith([&] { return (acquired = tryAcquireUpTo(maxCount)) != 0; }, sleepForever());
+    return acquired;
+}
+
+inline size_t Semaphore::tryWaitUpTo(size_t maxCount)
+{
+    return tryAcquireUpTo(maxCount);
 }
 
 template <class Rep, class Period>
 bool Semaphore::waitFor(const std::chrono::duration<Rep, Period>& duration, size_t count)
 {
-    std::unique_lock<std::mutex> lock{mutex_};
-    auto finished = condition_.wait_for(lock, duration, [&] { return count_ >= count; });
+    return waitUntil(std::chrono::steady_clock::now() + duration, count);
+}
+
+template <class Clock, class Duration>
+bool Semaphore::waitUntil(const std::chrono::time_point<Clock, Duration>& timePoint, size_t count)
+{
+    return acquireWith([&] { return tryAcquire(count); }, sleepUntil(timePoint));
+}
+
+inline size_t Semaphore::getCount() const
+{
+    return count_.load(std::memory_order_seq_cst);
+}
+
+inline void Semaphore::setName(std::string name)
+{
+    counters_.setName(std::move(name));
+}
 
-    if (finished)
+inline bool Semaphore::tryAcquire(size_t count)
+{
+    size_t current = count_.load(std::memory_order_seq_cst);
+    while (current >= count)
     {
-        count_ -= count;
+        if (count_.compare_exchange_weak(current, current - count, std::memory_order_seq_cst))
+            return true;
     }
 
-    return finished;
+    return false;
 }
 
-template <class Clock, class Duration>
-bool Semaphore::waitUntil(const std::chrono::time_point<Clock, Duration>& timePoint, size_t count)
+inline size_t Semaphore::tryAcquireUpTo(size_t maxCount)
+{
+    size_t current = count_.load(std::memory_order_seq_cst);
+    while (current > 0)
+    {
+        const size_t acquired = std::min(current, maxCount);
+        if (count_.compare_exchange_weak(current, current - acquired, std::memory_order_seq_cst))
+            return acquired;
+    }
+
+    return 0;
+}
+
+template <typename TryAcquire, typename Sleep>
+bool Semaphore::acquireWith(TryAcquire tryAcquire, Sleep sleep)
 {
-    std::unique_lock<std::mutex> lock{mutex_};
-    auto finished = condition_.wait_until(lock, timePoint, [&] { return count_ >= count; });
+    if (tryAcquire())
+    {
+        counters_.recordAcquisition();
+        return true;
+    }
 
-    if (finished)
-        count_ -= count;
+    const auto waitStart = counters_.now();
+    const bool acquired = waitAndAcquireWith(tryAcquire, sleep);
+    if (acquired)
+        counters_.recordContendedAcquisition(waitStart);
 
-    return finished;
+    return acquired;
 }
 
-inline size_t Semaphore::getCount() const
+template <typename TryAcquire, typename Sleep>
+bool Semaphore::waitAndAcquireWith(TryAcquire tryAcquire, Sleep sleep)
 {
-    std::lock_guard<std::mutex> lock{mutex_};
-    return count_;
+    for (int spin = 0; spin < SPIN_COUNT; ++spin)
+    {
+        if (tryAcquire())
+            return true;
+    }
+
+    sleeperCount_.fetch_add(1, std::memory_order_seq_cst);
+
+    bool acquired = false;
+    for (;;)
+    {
+        const uint32_t sequence = sequence_.load();
+        if (tryAcquire())
+        {
+            acquired = true;
+            break;
+        }
+
+        if (!sleep(sequence))
+        {
+            acquired = tryAcquire(); // One last time, in case we were notified while timing out
+            break;
+        }
+    }
+
+    sleeperCount_.fetch_sub(1, std::memory_order_seq_cst);
+    return acquired;
+}
+
+template <class Clock, class Duration>
+auto Semaphore::sleepUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    return [this, &timePoint](uint32_t sequence) {
+        const auto now = Clock::now();
+        if (now >= timePoint)
+            return false;
+
+        sequence_.waitFor(sequence, std::chrono::duration_cast<std::chrono::nanoseconds>(timePoint - now));
+        return true;
+    };
 }
 
 } // namespace Common
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "common/CacheLine.hpp"
+#include "common/Synchronized.hpp"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace Common {
+
+/**
+ * A synchronization wrapper splitting the data into independently locked shards
+ *
+ * Each key belongs to one shard, selected by the hash of the key. A transaction locks only the shard
+ * of its key, so threads working on keys in different shards proceed in parallel. Each shard is
+ * a Synchronized object on its own cache lines.
+ *
+ * Example:
+ *
+ *   ShardedSynchronized<std::unordered_map<int, Session>> sessions;
+ *
+ *   sessions.makeTransaction(id)->emplace(id, Session{}); // Locks only the shard of id
+ *
+ *   {
+ *       auto shard = sessions.makeTransaction(id);
+ *       auto found = shard->find(id);
+ *       ...
+ *   }
+ *
+ *   size_t count = 0;
+ *   sessions.forEachShard([&count](const auto& shard) { count += shard.size(); });
+ *
+ * Operations over all keys are not atomic, as the shards are locked one at a time.
+ *
+ * @tparam Data Data type of each shard, typically a map
+ * @tparam SHARD_COUNT Number of shards
+ * @tparam Hash Hash function for the keys, by default std::hash of Data::key_type
+ * @tparam Lock Lock policy of each shard, needs to create its own lock like InternalLock
+ */
+template <typename Data,
+          size_t SHARD_COUNT = 16,
+          typename Hash = std::hash<typename Data::key_type>,
+          typename Lock = InternalLock<std::mutex>>
+class ShardedSynchronized
+{
+public:
+    static_assert(SHARD_COUNT > 0, "Needs at least one shard");
+
+    /** Construct the data of each shard from @p args */
+    template <typename... Args>
+    explicit ShardedSynchronized(const Args&... args);
+
+    /** Prevent copy, assignment and move */
+    ShardedSynchronized(const ShardedSynchronized&) = delete;
+    ShardedSynchronized& operator=(const ShardedSynchronized&) = delete;
+    ShardedSynchronized& operator=(ShardedSynchronized&&) = delete;
+
+    /** @return Transaction object locking the shard of @p key, see Synchronized::makeTransaction */
+    template <typename Key>
+    auto makeTransaction(const Key& key);
+    template <typename Key>
+    auto makeTransaction(const Key& key) const;
+
+    /** Call @p fn with the data of each shard in turn, holding the lock of the shard during the call */
+    template <typename Fn>
+    void forEachShard(Fn fn);
+    template <typename Fn>
+    void forEachShard(Fn fn) const;
+
+    /** @return Index of the shard of @p key */
+    template <typename Key>
+    size_t getShardIndex(const Key& key) const;
+
+    /** @return Shard by @p index, for operations needing a shard other than by key */
+    ///@{
+    Synchronized<Data, Lock>& getShard(size_t index);
+    const Synchronized<Data, Lock>& getShard(size_t index) const;
+    ///@}
+
+private:
+    /** Shard on cache lines of its own, so locking it doesn't slow down the neighbours */
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        template <typename... Args>
+        explicit Shard(const Args&... args) : data_(args...)
+        {
+        }
+
+        Synchronized<Data, Lock> data_;
+    };
+
+    template <size_t... INDEX, typename... Args>
+    ShardedSynchronized(std::index_sequence<INDEX...>, const Args&... args);
+
+    Hash hash_;
+    std::array<Shard, SHARD_COUNT> shards_;
+};
+
+// ShardedSynchronized implementation
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename... Args>
+ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::ShardedSynchronized(const Args&... args)
+  : ShardedSynchronized(std::make_index_sequence<SHARD_COUNT>(), args...)
+{
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <size_t... INDEX, typename... Args>
+ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::ShardedSynchronized(std::index_sequence<INDEX...>,
+                                                                         const Args&... args)
+  : hash_(), shards_{{(static_cast<void>(INDEX), Shard(args...))...}}
+{
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename Key>
+auto ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::makeTransaction(const Key& key)
+{
+    return getShard(getShardIndex(key)).makeTransaction();
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename Key>
+auto ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::makeTransaction(const Key& key) const
+{
+    return getShard(getShardIndex(key)).makeTransaction();
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename Fn>
+void ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::forEachShard(Fn fn)
+{
+    for (auto& shard : shards_)
+    {
+        auto transaction = shard.data_.makeTransaction();
+        fn(*transaction.operator->());
+    }
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename Fn>
+void ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::forEachShard(Fn fn) const
+{
+    for (const auto& shard : shards_)
+    {
+        auto transaction = shard.data_.makeTransaction();
+        fn(*transaction.operator->());
+    }
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+template <typename Key>
+size_t ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::getShardIndex(const Key& key) const
+{
+    // Mix the bits, as e.g. std::hash of an integer is often the integer itself
+    const uint64_t mixed = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>((mixed >> 32) % SHARD_COUNT);
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+Synchronized<Data, Lock>& ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::getShard(size_t index)
+{
+    return shards_[index].data_;
+}
+
+template <typename Data, size_t SHARD_COUNT, typename Hash, typename Lock>
+const Synchronized<Data, Lock>& ShardedSynchronized<Data, SHARD_COUNT, Hash, Lock>::getShard(size_t index) const
+{
+    return shards_[index].data_;
+}
+
+} // namespace Common
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace Common {
+
+/**
+ * A synchronization wrapper publishing immutable versions of the data (read-copy-update)
+ *
+ * Readers get a snapshot of the current version, which stays valid and unchanged as long as
+ * they hold it. Readers don't wait for write transactions, and long traversals of big structures
+ * hold no lock.
+ *
+ * Getting a snapshot is not free though. The current version is loaded and stored with the atomic
+ * shared_ptr functions, which libstdc++ implements with a global pool of mutexes, locked for the
+ * moment of the load or store. And every snapshot increments and decrements the reference count
+ * shared by all readers of the version. With many concurrent readers both are contended, so take
+ * a snapshot per traversal rather than per access.
+ *
+ * Writers are serialized with a lock. A write transaction works on a private copy of the current
+ * version and publishes it atomically when the transaction goes out of scope. If the transaction
+ * is left with an exception, the copy is discarded and nothing is published.
+ *
+ * Example:
+ *
+ *   SnapshotSynchronized<RoutingTable> table;
+ *
+ *   // Reader
+ *   auto snapshot = std::as_const(table).makeTransaction();
+ *   snapshot->lookup(...); // No lock held, writers may publish meanwhile
+ *
+ *   // Writer
+ *   {
+ *       auto t = table.makeTransaction();
+ *       t->add(...);
+ *       t->remove(...);
+ *   } // Readers see both changes at once from now on
+ *
+ * Writing copies the whole data, so prefer this for data read much more often than written.
+ *
+ * @tparam Data Wrapped data type, needs to be copy constructible
+ * @tparam Lock Lock type serializing the writers
+ */
+template <typename Data, typename Lock = std::mutex>
+class SnapshotSynchronized
+{
+public:
+    /** Handle to an immutable version of the data */
+    using Snapshot = std::shared_ptr<const Data>;
+
+    /** Constructor template to construct the initial version of the data */
+    template <typename... Args>
+    SnapshotSynchronized(Args&&... args);
+
+    /** Prevent copy, assignment and move */
+    SnapshotSynchronized(const SnapshotSynchronized&) = delete;
+    SnapshotSynchronized& operator=(const SnapshotSynchronized&) = delete;
+    SnapshotSynchronized& operator=(SnapshotSynchronized&&) = delete;
+
+    /** Arrow operator to conveniently perform single call transactions */
+    auto operator-> ();
+    Snapshot operator-> () const;
+
+    /** @return Transaction object to perform a series of modifications published at once */
+    auto makeTransaction();
+
+    /** @return Snapshot of the current version */
+    Snapshot makeTransaction() const;
+
+private:
+    /** Transaction to modify a copy of the data and publish it at the end */
+    class Transaction
+    {
+    public:
+        // Transaction can be moved to allow return by value @see SnapshotSynchronized::makeTransaction
+        Transaction(Transaction&& other);
+
+        ~Transaction();
+
+        /** Get access to the copy of the data and its original operations */
+        Data* operator->();
+
+    private:
+        friend class SnapshotSynchronized;
+
+        // Can be constructed only by class SnapshotSynchronized
+        Transaction(SnapshotSynchronized& obj);
+
+        // No copying
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        SnapshotSynchronized* obj_;
+        std::shared_ptr<Data> draft_;
+        int uncaughtExceptions_; ///< At construction, more at destruction means unwinding
+    };
+
+    Snapshot current_; ///< Accessed only with the atomic shared_ptr functions
+    Lock lock_;
+};
+
+// SnapshotSynchronized implementation
+template <typename Data, typename Lock>
+template <typename... Args>
+SnapshotSynchronized<Data, Lock>::SnapshotSynchronized(Args&&... args)
+  : current_(std::make_shared<const Data>(std::forward<Args>(args)...)), lock_()
+{
+}
+
+template <typename Data, typename Lock>
+auto SnapshotSynchronized<Data, Lock>::operator-> ()
+{
+    return makeTransaction();
+}
+
+template <typename Data, typename Lock>
+typename SnapshotSynchronized<Data, Lock>::Snapshot SnapshotSynchronized<Data, Lock>::operator-> () const
+{
+    return makeTransaction();
+}
+
+template <typename Data, typename Lock>
+auto SnapshotSynchronized<Data, Lock>::makeTransaction()
+{
+    return Transaction(*this);
+}
+
+template <typename Data, typename Lock>
+typename SnapshotSynchronized<Data, Lock>::Snapshot SnapshotSynchronized<Data, Lock>::makeTransaction() const
+{
+    return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+}
+
+// SnapshotSynchronized::Transaction implementation
+template <typename Data, typename Lock>
+SnapshotSynchronized<Data, Lock>::Transaction::Transaction(SnapshotSynchronized& obj)
+  : obj_(&obj), draft_(), uncaughtExceptions_(std::uncaught_exceptions())
+{
+    obj_->lock_.lock();
+
+    try
+    {
+        // Only writers replace the current version, and we hold the lock
+        draft_ = std::make_shared<Data>(*obj_->current_);
+    }
+    catch (...)
+    {
+        obj_->lock_.unlock();
+        throw;
+    }
+}
+
+template <typename Data, typename Lock>
+SnapshotSynchronized<Data, Lock>::Transaction::Transaction(Transaction&& other)
+  : obj_(other.obj_), draft_(std::move(other.draft_)), uncaughtExceptions_(other.uncaughtExceptions_)
+{
+    other.obj_ = nullptr;
+}
+
+template <typename Data, typename Lock>
+SnapshotSynchronized<Data, Lock>::Transaction::~Transaction()
+{
+    if (obj_)
+    {
+        // A writer failing halfway must not publish a half-modified version
+        if (std::uncaught_exceptions() <= uncaughtExceptions_)
+            std::atomic_store_explicit(&obj_->current_, Snapshot(std::move(draft_)), std::memory_order_release);
+        obj_->lock_.unlock();
+    }
+}
+
+template <typename Data, typename Lock>
+Data* SnapshotSynchronized<Data, Lock>::Transaction::operator->()
+{
+    return draft_.get();
+}
+
+} // namespace Common
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace Common {
+
+/**
+ * Adaptive spin lock for very short critical sections.
+ *
+ * A contended lock() first spins, and then yields the processor between attempts. The number of
+ * spins adapts to how long the lock has recently been held: it grows when spinning pays off
+ * and shrinks when the lock had to be waited for by yielding.
+ *
+ * Satisfies Lockable, so it can be used e.g. with std::lock_guard and InternalLock.
+ */
+class SpinLock
+{
+public:
+    /** Upper limit for spins before yielding */
+    static constexpr int MAX_SPIN_COUNT = 1024;
+
+    SpinLock();
+
+    /** Prevent copy, assignment and move */
+    SpinLock(const SpinLock&) = delete;
+    SpinLock& operator=(const SpinLock&) = delete;
+    SpinLock& operator=(SpinLock&&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    std::atomic<bool> locked_;
+    std::atomic<int> spinCount_; ///< Current estimate of spins worth doing
+
+    /** Hint the processor we are spinning */
+    static void pause();
+};
+
+inline SpinLock::SpinLock() : locked_{false}, spinCount_{16} {}
+
+inline void SpinLock::lock()
+{
+    if (try_lock())
+        return;
+
+    const int estimate = spinCount_.load(std::memory_order_relaxed);
+    const int maxSpins = std::min(MAX_SPIN_COUNT, 2 * estimate + 16);
+
+    for (int spin = 0; spin < maxSpins; ++spin)
+    {
+        pause();
+        if (!locked_.load(std::memory_order_relaxed) && try_lock())
+        {
+            spinCount_.store(estimate + (spin - estimate) / 8, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    spinCount_.store(estimate / 2, std::memory_order_relaxed);
+    while (locked_.load(std::memory_order_relaxed) || !try_lock())
+    {
+        std::this_thread::yield();
+    }
+}
+
+inline bool SpinLock::try_lock()
+{
+    return !locked_.exchange(true, std::memory_order_acquire);
+}
+
+inline void SpinLock::unlock()
+{
+    locked_.store(false, std::memory_order_release);
+}
+
+inline void SpinLock::pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+} // namespace Common
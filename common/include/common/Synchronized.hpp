@@ -1,10 +1,33 @@
 #pragma once
 
+#include "common/LockStatistics.hpp"
+#include "common/SpinLock.hpp"
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace Common {
 
-/** Synchronized data lock policies. */
+/**
+ * Synchronized data lock policies.
+ *
+ * A policy implements lock() and unlock(). It may also implement lockShared() and unlockShared(),
+ * which are then used for const transactions instead.
+ *
+ * An optimistic policy implements readSnapshot() and publish() instead of the shared locking.
+ * Const transactions then work on a snapshot of the data, see SeqLock.
+ */
 ///@{
 
 /** Original data class must implement lock() and unlock() itself */
@@ -45,8 +68,159 @@ private:
     Lock& lock_;
 };
 
+/** A new shared lock is created by Synchronized class, const transactions can proceed in parallel */
+template <typename Lock = std::shared_mutex, typename Data = void>
+class InternalSharedLock
+{
+public:
+    InternalSharedLock() : lock_() {}
+    void lock(Data*) { lock_.lock(); }
+    void unlock(Data*) { lock_.unlock(); }
+    void lockShared(Data*) { lock_.lock_shared(); }
+    void unlockShared(Data*) { lock_.unlock_shared(); }
+
+private:
+    Lock lock_;
+};
+
+/** An external shared lock is provided to Synchronized class, const transactions can proceed in parallel */
+template <typename Lock = std::shared_mutex, typename Data = void>
+class ExternalSharedLock
+{
+public:
+    ExternalSharedLock(Lock& lock) : lock_(lock) {}
+    ExternalSharedLock(ExternalSharedLock&& other) = default;
+
+    void lock(Data*) { lock_.lock(); }
+    void unlock(Data*) { lock_.unlock(); }
+    void lockShared(Data*) { lock_.lock_shared(); }
+    void unlockShared(Data*) { lock_.unlock_shared(); }
+
+private:
+    ExternalSharedLock(const ExternalSharedLock& other) = delete;
+    Lock& lock_;
+};
+
+/** A new adaptive spin lock is created by Synchronized class, for very short transactions */
+template <typename Data = void>
+using InternalSpinLock = InternalLock<SpinLock, Data>;
+
+// Layout depends on the lock statistics setting, see LockStatistics.hpp
+inline namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE {
+
+/**
+ * A new lock is created by Synchronized class, and its contention is recorded under a name.
+ * See LockStatisticsRegistry, recording is enabled at compile time with LL_TOOLKIT_LOCK_STATISTICS.
+ */
+template <typename Lock = std::mutex, typename Data = void>
+class InstrumentedLock
+{
+public:
+    InstrumentedLock() : lock_(), counters_(), holdStart_() {}
+    explicit InstrumentedLock(std::string name) : lock_(), counters_(std::move(name)), holdStart_() {}
+    InstrumentedLock(InstrumentedLock&& other) : lock_(), counters_(std::move(other.counters_)), holdStart_() {}
+
+    void lock(Data*)
+    {
+        if (lock_.try_lock())
+        {
+            counters_.recordAcquisition();
+        }
+        else
+        {
+            const auto waitStart = counters_.now();
+            lock_.lock();
+            counters_.recordContendedAcquisition(waitStart);
+        }
+        holdStart_ = counters_.now();
+    }
+    void unlock(Data*)
+    {
+        counters_.recordRelease(holdStart_);
+        lock_.unlock();
+    }
+
+private:
+    InstrumentedLock(const InstrumentedLock& other) = delete;
+
+    Lock lock_;
+    LockCounters counters_;
+    LockCounters::Clock::time_point holdStart_; ///< Accessed only by the lock holder
+};
+
+} // namespace LL_TOOLKIT_LOCK_STATISTICS_NAMESPACE
+
+/**
+ * Sequence lock for small trivially copyable and default constructible data.
+ *
+ * Writers take an exclusive @p Lock and publish a copy of the data when unlocking. Const transactions
+ * copy the published data optimistically and retry if a writer published meanwhile. Readers thus
+ * never write to shared memory, but work on a snapshot of the data.
+ */
+template <typename Data, typename Lock = SpinLock>
+class SeqLock
+{
+public:
+    using Value = std::remove_const_t<Data>;
+    static_assert(std::is_trivially_copyable<Value>::value, "SeqLock needs trivially copyable data");
+    static_assert(std::is_default_constructible<Value>::value, "SeqLock copies the snapshot into a default value");
+
+    SeqLock() : lock_(), sequence_{0}, words_{} {}
+
+    void lock(Data*) { lock_.lock(); }
+    void unlock(Data* data)
+    {
+        publish(data);
+        lock_.unlock();
+    }
+
+    /** Make @p data visible to readSnapshot. Needs the lock, or no concurrent writers. */
+    void publish(const Data* data);
+
+    /** @return Consistent copy of the last published data */
+    Value readSnapshot() const;
+
+private:
+    using Word = std::uintptr_t;
+    static constexpr size_t WORD_COUNT = (sizeof(Value) + sizeof(Word) - 1) / sizeof(Word);
+
+    Lock lock_;
+    std::atomic<size_t> sequence_; ///< Odd while publishing
+    std::array<std::atomic<Word>, WORD_COUNT> words_;
+};
+
+/** Check whether lock policy @p Lock supports shared locking */
+///@{
+template <typename Lock, typename = void>
+struct has_shared_locking : std::false_type
+{
+};
+template <typename Lock>
+struct has_shared_locking<Lock, std::void_t<decltype(&Lock::lockShared), decltype(&Lock::unlockShared)>>
+  : std::true_type
+{
+};
 ///@}
 
+/** Check whether lock policy @p Lock supports optimistic reading */
+///@{
+template <typename Lock, typename = void>
+struct has_optimistic_reading : std::false_type
+{
+};
+template <typename Lock>
+struct has_optimistic_reading<Lock, std::void_t<decltype(&Lock::readSnapshot), decltype(&Lock::publish)>>
+  : std::true_type
+{
+};
+///@}
+
+///@}
+
+// Befriended by Synchronized, documented with the definition below
+template <typename... Objects>
+auto synchronize(Objects&... objects);
+
 /**
  * A generic synchronization wrapper
  *
@@ -71,6 +245,11 @@ private:
  *       t->doThat();
  *   }
  *
+ * Const access takes a shared lock if the lock policy supports it, see InternalSharedLock,
+ * or reads a snapshot of the data if the lock policy is optimistic, see SeqLock.
+ *
+ * Use synchronize to make a transaction over several Synchronized objects.
+ *
  * @tparam Data Wrapped data type
  * @tparam Lock Lock policy
  */
@@ -116,6 +295,7 @@ private:
 
         // Can be constructed only by class Synchronized
         Transaction(Synchronized& obj);
+        Transaction(Synchronized& obj, std::adopt_lock_t);
 
         // No copying
         Transaction(const Transaction&) = delete;
@@ -141,6 +321,7 @@ private:
 
         // Can be constructed only by class Synchronized
         ConstTransaction(const Synchronized& obj);
+        ConstTransaction(const Synchronized& obj, std::adopt_lock_t);
 
         // No copying
         ConstTransaction(const ConstTransaction&) = delete;
@@ -148,13 +329,113 @@ private:
 
         const Synchronized* obj_;
     };
+
+    /** Transaction to read a consistent snapshot of the data with an optimistic lock policy */
+    class SnapshotTransaction
+    {
+    public:
+        /** Get access to the snapshot and its const operations */
+        const Data* operator->() const;
+
+    private:
+        friend class Synchronized;
+
+        // Can be constructed only by class Synchronized
+        SnapshotTransaction(const Synchronized& obj);
+
+        std::remove_const_t<Data> snapshot_;
+    };
+
+    /** Make the initial data visible with an optimistic lock policy */
+    void publishInitialData();
+
+    /** Locking for the transactions */
+    ///@{
+    void lockForTransaction();
+    void lockForTransaction() const;
+    void unlockForTransaction();
+    void unlockForTransaction() const;
+    ///@}
+
+    /** @return Transaction for an already locked object */
+    ///@{
+    Transaction adoptTransaction();
+    ConstTransaction adoptTransaction() const;
+    ///@}
+
+    template <typename... Objects>
+    friend auto synchronize(Objects&... objects);
 };
 
+/**
+ * Make a transaction over several Synchronized objects.
+ *
+ * The objects are locked in the order of their addresses, so concurrent calls to synchronize
+ * with the same objects in any order can't deadlock. Const objects get a const transaction.
+ * If locking one of the objects throws, the ones already locked are unlocked before rethrowing.
+ * The objects must not share an external lock, and optimistic lock policies are not supported.
+ *
+ * Example:
+ *
+ *   Synchronized<Account> from, to;
+ *   {
+ *       auto [f, t] = synchronize(from, to);
+ *       // Holding both locks until f and t go out of scope
+ *       f->withdraw(10);
+ *       t->deposit(10);
+ *   }
+ *
+ * @return Tuple of transactions, one for each object in the order given
+ */
+template <typename... Objects>
+auto synchronize(Objects&... objects)
+{
+    struct LockOrder
+    {
+        const void* address_;
+        void (*lock_)(const void* object);
+        void (*unlock_)(const void* object);
+    };
+
+    std::array<LockOrder, sizeof...(Objects)> order{{LockOrder{
+        static_cast<const void*>(&objects),
+        [](const void* object) { static_cast<Objects*>(const_cast<void*>(object))->lockForTransaction(); },
+        [](const void* object) { static_cast<Objects*>(const_cast<void*>(object))->unlockForTransaction(); }}...}};
+
+    std::sort(order.begin(), order.end(), [](const LockOrder& a, const LockOrder& b) {
+        return std::less<const void*>()(a.address_, b.address_);
+    });
+    assert(std::adjacent_find(order.begin(), order.end(), [](const LockOrder& a, const LockOrder& b) {
+               return a.address_ == b.address_;
+           }) == order.end()); // Same object given twice
+
+    auto locked = order.begin();
+    try
+    {
+        for (; locked != order.end(); ++locked)
+        {
+            locked->lock_(locked->address_);
+        }
+    }
+    catch (...)
+    {
+        while (locked != order.begin())
+        {
+            --locked;
+            locked->unlock_(locked->address_);
+        }
+        throw;
+    }
+
+    return std::make_tuple(objects.adoptTransaction()...);
+}
+
 // Synchronized implementation
 template <typename Data, typename Lock>
 template <typename... Args>
 Synchronized<Data, Lock>::Synchronized(const Lock& lock, Args&&... args) : Data(std::forward<Args>(args)...), Lock(lock)
 {
+    publishInitialData();
 }
 
 template <typename Data, typename Lock>
@@ -162,12 +443,14 @@ template <typename... Args>
 Synchronized<Data, Lock>::Synchronized(Lock&& lock, Args&&... args)
   : Data(std::forward<Args>(args)...), Lock(std::forward<Lock>(lock))
 {
+    publishInitialData();
 }
 
 template <typename Data, typename Lock>
 template <typename... Args>
 Synchronized<Data, Lock>::Synchronized(Args&&... args) : Data(std::forward<Args>(args)...), Lock()
 {
+    publishInitialData();
 }
 
 template <typename Data, typename Lock>
@@ -191,14 +474,75 @@ auto Synchronized<Data, Lock>::makeTransaction()
 template <typename Data, typename Lock>
 auto Synchronized<Data, Lock>::makeTransaction() const
 {
-    return ConstTransaction(*this);
+    if constexpr (has_optimistic_reading<Lock>::value)
+        return SnapshotTransaction(*this);
+    else
+        return ConstTransaction(*this);
+}
+
+template <typename Data, typename Lock>
+void Synchronized<Data, Lock>::publishInitialData()
+{
+    if constexpr (has_optimistic_reading<Lock>::value)
+        Lock::publish(this);
+}
+
+template <typename Data, typename Lock>
+void Synchronized<Data, Lock>::lockForTransaction()
+{
+    Lock::lock(this);
+}
+
+template <typename Data, typename Lock>
+void Synchronized<Data, Lock>::lockForTransaction() const
+{
+    static_assert(!has_optimistic_reading<Lock>::value, "Optimistic reading takes no lock");
+
+    Synchronized* nonConstData = const_cast<Synchronized*>(this);
+    if constexpr (has_shared_locking<Lock>::value)
+        nonConstData->Lock::lockShared(nonConstData);
+    else
+        nonConstData->Lock::lock(nonConstData);
+}
+
+template <typename Data, typename Lock>
+void Synchronized<Data, Lock>::unlockForTransaction()
+{
+    Lock::unlock(this);
+}
+
+template <typename Data, typename Lock>
+void Synchronized<Data, Lock>::unlockForTransaction() const
+{
+    Synchronized* nonConstData = const_cast<Synchronized*>(this);
+    if constexpr (has_shared_locking<Lock>::value)
+        nonConstData->Lock::unlockShared(nonConstData);
+    else
+        nonConstData->Lock::unlock(nonConstData);
+}
+
+template <typename Data, typename Lock>
+typename Synchronized<Data, Lock>::Transaction Synchronized<Data, Lock>::adoptTransaction()
+{
+    return Transaction(*this, std::adopt_lock);
+}
+
+template <typename Data, typename Lock>
+typename Synchronized<Data, Lock>::ConstTransaction Synchronized<Data, Lock>::adoptTransaction() const
+{
+    return ConstTransaction(*this, std::adopt_lock);
 }
 
 // Synchronized::Transaction implementation
 template <typename Data, typename Lock>
 Synchronized<Data, Lock>::Transaction::Transaction(Synchronized& obj) : obj_(&obj)
 {
-    obj_->Lock::lock(obj_);
+    obj_->lockForTransaction();
+}
+
+template <typename Data, typename Lock>
+Synchronized<Data, Lock>::Transaction::Transaction(Synchronized& obj, std::adopt_lock_t) : obj_(&obj)
+{
 }
 
 template <typename Data, typename Lock>
@@ -212,7 +556,7 @@ Synchronized<Data, Lock>::Transaction::~Transaction()
 {
     if (obj_)
     {
-        obj_->Lock::unlock(obj_);
+        obj_->unlockForTransaction();
     }
 }
 
@@ -226,8 +570,13 @@ Data* Synchronized<Data, Lock>::Transaction::operator->()
 template <typename Data, typename Lock>
 Synchronized<Data, Lock>::ConstTransaction::ConstTransaction(const Synchronized& obj) : obj_(&obj)
 {
-    Synchronized* nonConstData = const_cast<Synchronized*>(obj_);
-    nonConstData->Lock::lock(nonConstData);
+    obj_->lockForTransaction();
+}
+
+template <typename Data, typename Lock>
+Synchronized<Data, Lock>::ConstTransaction::ConstTransaction(const Synchronized& obj, std::adopt_lock_t)
+  : obj_(&obj)
+{
 }
 
 template <typename Data, typename Lock>
@@ -241,8 +590,7 @@ Synchronized<Data, Lock>::ConstTransaction::~ConstTransaction()
 {
     if (obj_)
     {
-        Synchronized* nonConstData = const_cast<Synchronized*>(obj_);
-        nonConstData->Lock::unlock(nonConstData);
+        obj_->unlockForTransaction();
     }
 }
 
@@ -252,4 +600,65 @@ const Data* Synchronized<Data, Lock>::ConstTransaction::operator->() const
     return obj_;
 }
 
+// Synchronized::SnapshotTransaction implementation
+template <typename Data, typename Lock>
+Synchronized<Data, Lock>::SnapshotTransaction::SnapshotTransaction(const Synchronized& obj)
+  : snapshot_(obj.Lock::readSnapshot())
+{
+}
+
+template <typename Data, typename Lock>
+const Data* Synchronized<Data, Lock>::SnapshotTransaction::operator->() const
+{
+    return &snapshot_;
+}
+
+// SeqLock implementation
+template <typename Data, typename Lock>
+void SeqLock<Data, Lock>::publish(const Data* data)
+{
+    std::array<Word, WORD_COUNT> buffer{};
+    std::memcpy(buffer.data(), data, sizeof(Value));
+
+    const size_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // Readers seeing any new word see the odd sequence
+
+    for (size_t i = 0; i < WORD_COUNT; ++i)
+    {
+        words_[i].store(buffer[i], std::memory_order_relaxed);
+    }
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+template <typename Data, typename Lock>
+typename SeqLock<Data, Lock>::Value SeqLock<Data, Lock>::readSnapshot() const
+{
+    std::array<Word, WORD_COUNT> buffer;
+
+    for (;;)
+    {
+        const size_t sequence = sequence_.load(std::memory_order_acquire);
+        if (sequence % 2 != 0)
+        {
+            std::this_thread::yield(); // Writer is publishing
+            continue;
+        }
+
+        for (size_t i = 0; i < WORD_COUNT; ++i)
+        {
+            buffer[i] = words_[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire); // Words are read before checking the sequence again
+        if (sequence_.load(std::memory_order_relaxed) == sequence)
+            break;
+    }
+
+    Value value;
+    std::memcpy(static_cast<void*>(&value), buffer.data(), sizeof(Value)); // Value is trivially copyable
+    return value;
+}
+
 } // namespace Common
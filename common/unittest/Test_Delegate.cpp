@@ -0,0 +1,94 @@
+#include "common/Delegate.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <string>
+#include <type_traits>
+
+namespace Common {
+
+namespace {
+
+class Interface
+{
+public:
+    virtual ~Interface() = default;
+    virtual void notify(const std::string& text) = 0;
+};
+
+class Target : public Interface
+{
+public:
+    MOCK_METHOD1(notify, void(const std::string& text));
+    MOCK_METHOD1(notifyValue, int(std::string text));
+    MOCK_METHOD0(notifyEmpty, void());
+};
+
+std::string lastText;
+int calls = 0;
+
+void function(const std::string& text)
+{
+    lastText = text;
+    ++calls;
+}
+
+int functionEmpty()
+{
+    ++calls;
+    return 1;
+}
+
+using StringDelegate = Delegate<void(const std::string&)>;
+
+} // anonymous namespace
+
+TEST(Delegate, MemberFunction)
+{
+    testing::StrictMock<Target> target;
+    const auto reference = StringDelegate::fromMember(target, &Target::notifyValue);
+    const auto empty = StringDelegate::fromMember(target, &Target::notifyEmpty);
+
+    EXPECT_CALL(target, notifyValue("value")).WillOnce(testing::Return(5));
+    EXPECT_CALL(target, notifyEmpty());
+
+    reference("value");
+    empty("ignored");
+}
+
+TEST(Delegate, VirtualMemberFunction)
+{
+    testing::StrictMock<Target> target;
+    Interface& interface = target;
+    const auto delegate = StringDelegate::fromMember(interface, &Interface::notify);
+
+    EXPECT_CALL(target, notify("virtual"));
+    delegate("virtual");
+}
+
+TEST(Delegate, FreeFunction)
+{
+    calls = 0;
+    const auto delegate = StringDelegate::fromFunction(&function);
+    const auto empty = StringDelegate::fromFunction(&functionEmpty);
+
+    delegate("free");
+    empty("ignored");
+
+    EXPECT_EQ("free", lastText);
+    EXPECT_EQ(2, calls);
+}
+
+TEST(Delegate, Copy)
+{
+    static_assert(std::is_trivially_copyable<StringDelegate>::value, "Delegate should be copyable as bytes");
+
+    testing::StrictMock<Target> target;
+    auto delegate = StringDelegate::fromFunction(&function);
+    const auto copy = StringDelegate::fromMember(target, &Target::notifyEmpty);
+    delegate = copy;
+
+    EXPECT_CALL(target, notifyEmpty());
+    delegate("copied");
+}
+
+} // namespace Common
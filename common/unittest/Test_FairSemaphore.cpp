@@ -0,0 +1,157 @@
+#include "common/FairSemaphore.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace Common {
+
+namespace {
+
+void waitForWaiters(const FairSemaphore& semaphore, size_t waiterCount)
+{
+    while (semaphore.getWaiterCount() != waiterCount)
+    {
+        std::this_thread::yield();
+    }
+}
+
+} // anonymous namespace
+
+TEST(FairSemaphore, Counting)
+{
+    FairSemaphore semaphore(2);
+    EXPECT_EQ(2u, semaphore.getCount());
+
+    EXPECT_TRUE(semaphore.tryWait());
+    EXPECT_FALSE(semaphore.tryWait(2));
+    EXPECT_TRUE(semaphore.tryWait());
+    EXPECT_FALSE(semaphore.tryWait());
+
+    semaphore.notify(5);
+    EXPECT_EQ(3u, semaphore.tryWaitUpTo(3));
+    EXPECT_EQ(2u, semaphore.waitUpTo(3));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(3));
+
+    semaphore.notify(3);
+    semaphore.wait(3);
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+TEST(FairSemaphore, ZeroMaxCount)
+{
+    FairSemaphore semaphore;
+    EXPECT_EQ(0u, semaphore.waitUpTo(0));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(0));
+
+    semaphore.notify(2);
+    EXPECT_EQ(0u, semaphore.waitUpTo(0));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(0));
+    EXPECT_EQ(2u, semaphore.getCount());
+}
+
+TEST(FairSemaphore, Timeout)
+{
+    FairSemaphore semaphore;
+    EXPECT_FALSE(semaphore.waitFor(std::chrono::milliseconds(1)));
+    EXPECT_FALSE(semaphore.waitUntil(std::chrono::system_clock::now() + std::chrono::milliseconds(1)));
+    EXPECT_EQ(0u, semaphore.getWaiterCount());
+
+    semaphore.notify();
+    EXPECT_FALSE(semaphore.waitFor(std::chrono::milliseconds(1), 2));
+    EXPECT_TRUE(semaphore.waitFor(std::chrono::milliseconds(1)));
+}
+
+TEST(FairSemaphore, BigWaiterIsNotStarved)
+{
+    FairSemaphore semaphore;
+    std::atomic<int> order{0};
+    int bigWaiterOrder = 0;
+    int smallWaiterOrder = 0;
+
+    std::thread bigWaiter([&] {
+        semaphore.wait(5);
+        bigWaiterOrder = ++order;
+    });
+    waitForWaiters(semaphore, 1);
+
+    std::thread smallWaiter([&] {
+        semaphore.wait(1);
+        smallWaiterOrder = ++order;
+    });
+    waitForWaiters(semaphore, 2);
+
+    // Enough for the small waiter, but the big one is first in line
+    semaphore.notify(1);
+    EXPECT_FALSE(semaphore.tryWait());
+    EXPECT_EQ(2u, semaphore.getWaiterCount());
+
+    semaphore.notify(4);
+    bigWaiter.join();
+    EXPECT_EQ(1, bigWaiterOrder);
+    EXPECT_EQ(1u, semaphore.getWaiterCount());
+
+    semaphore.notify(1);
+    smallWaiter.join();
+    EXPECT_EQ(2, smallWaiterOrder);
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+TEST(FairSemaphore, TimedOutWaiterLetsOthersContinue)
+{
+    FairSemaphore semaphore;
+
+    std::thread bigWaiter([&] { EXPECT_FALSE(semaphore.waitFor(std::chrono::milliseconds(50), 5)); });
+    waitForWaiters(semaphore, 1);
+
+    std::thread smallWaiter([&] { EXPECT_TRUE(semaphore.waitFor(std::chrono::seconds(10), 1)); });
+    waitForWaiters(semaphore, 2);
+
+    semaphore.notify(1);
+
+    bigWaiter.join();
+    smallWaiter.join();
+    EXPECT_EQ(0u, semaphore.getCount());
+    EXPECT_EQ(0u, semaphore.getWaiterCount());
+}
+
+TEST(FairSemaphore, ManyWaitersAndNotifiers)
+{
+    static const int threadCount = 4;
+    static const int countPerThread = 10000;
+
+    FairSemaphore semaphore;
+    std::atomic<int> acquired{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&, t] {
+            const size_t count = 1 + t % 2;
+            for (int i = 0; i < countPerThread; ++i)
+            {
+                semaphore.wait(count);
+                acquired += static_cast<int>(count);
+            }
+        });
+        threads.emplace_back([&, t] {
+            const size_t count = 1 + t % 2;
+            for (int i = 0; i < countPerThread; ++i)
+            {
+                semaphore.notify(count);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(threadCount / 2 * 3 * countPerThread, acquired.load());
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+} // namespace Common
@@ -0,0 +1,178 @@
+#include "common/LockStatistics.hpp"
+#include "common/Semaphore.hpp"
+#include "common/Synchronized.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace Common {
+
+namespace {
+
+class Counter
+{
+public:
+    Counter(int value) : value_(value) {}
+
+    void increment() { ++value_; }
+    int get() const { return value_; }
+
+private:
+    int value_;
+};
+
+/**
+ * Mutex telling when a thread blocks on it. InstrumentedLock calls lock only after try_lock failed
+ * and the wait started.
+ */
+class BlockingMutex
+{
+public:
+    static std::atomic<int> blockedCount_;
+
+    bool try_lock() { return mutex_.try_lock(); }
+    void lock()
+    {
+        ++blockedCount_;
+        mutex_.lock();
+    }
+    void unlock() { mutex_.unlock(); }
+
+private:
+    std::mutex mutex_;
+};
+
+std::atomic<int> BlockingMutex::blockedCount_{0};
+
+/** @return Statistics registered under @p name, empty name if there are none */
+LockStatistics findStatistics(const std::string& name)
+{
+    for (const auto& statistics : LockStatisticsRegistry::instance().getStatistics())
+    {
+        if (statistics.name_ == name)
+            return statistics;
+    }
+    return {};
+}
+
+} // anonymous namespace
+
+TEST(TestLockStatistics, testInstrumentedLock)
+{
+    Synchronized<Counter, InstrumentedLock<>> counter(InstrumentedLock<>("counter"), 0);
+
+    counter->increment();
+    counter->increment();
+    EXPECT_EQ(2, counter->get());
+
+    const auto statistics = findStatistics("counter");
+    if (LockCounters::ENABLED)
+    {
+        EXPECT_EQ("counter", statistics.name_);
+        EXPECT_EQ(3u, statistics.acquisitions_);
+        EXPECT_EQ(0u, statistics.contendedAcquisitions_);
+    }
+    else
+    {
+        EXPECT_TRUE(statistics.name_.empty());
+    }
+}
+
+TEST(TestLockStatistics, testContendedLock)
+{
+    using Lock = InstrumentedLock<BlockingMutex>;
+    Synchronized<Counter, Lock> counter(Lock("contended"), 0);
+    BlockingMutex::blockedCount_ = 0;
+
+    std::thread holder;
+    {
+        auto transaction = counter.makeTransaction();
+        holder = std::thread([&counter] { counter->increment(); });
+
+        // Make sure the other thread is waiting, however late it gets scheduled
+        while (BlockingMutex::blockedCount_ == 0)
+        {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        transaction->increment();
+    }
+    holder.join();
+
+    EXPECT_EQ(2, counter->get());
+
+    const auto statistics = findStatistics("contended");
+    if (LockCounters::ENABLED)
+    {
+        EXPECT_EQ(3u, statistics.acquisitions_);
+        EXPECT_EQ(1u, statistics.contendedAcquisitions_);
+        EXPECT_LE(std::chrono::milliseconds(1), statistics.totalWaitTime_);
+        EXPECT_LE(std::chrono::milliseconds(20), statistics.maxHoldTime_);
+    }
+}
+
+TEST(TestLockStatistics, testNamedSemaphore)
+{
+    Semaphore semaphore(1);
+    semaphore.setName("semaphore");
+
+    semaphore.wait();
+    std::thread notifier([&semaphore] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        semaphore.notify();
+    });
+    semaphore.wait();
+    notifier.join();
+
+    const auto statistics = findStatistics("semaphore");
+    if (LockCounters::ENABLED)
+    {
+        EXPECT_EQ(2u, statistics.acquisitions_);
+        EXPECT_EQ(1u, statistics.contendedAcquisitions_);
+        EXPECT_LE(std::chrono::milliseconds(1), statistics.totalWaitTime_);
+    }
+}
+
+TEST(TestLockStatistics, testRegistration)
+{
+    {
+        Semaphore semaphore;
+        semaphore.setName("first");
+        semaphore.setName("second");
+
+        EXPECT_TRUE(findStatistics("first").name_.empty());
+        EXPECT_EQ(LockCounters::ENABLED, findStatistics("second").name_ == "second");
+
+        std::ostringstream dump;
+        LockStatisticsRegistry::instance().dump(dump);
+        EXPECT_EQ(LockCounters::ENABLED, dump.str().find("second: acquisitions 0") != std::string::npos);
+    }
+
+    // Destroyed instances are removed
+    EXPECT_TRUE(findStatistics("second").name_.empty());
+}
+
+TEST(TestLockStatistics, testSettingInMangledNames)
+{
+    // Code built with the other setting doesn't link with these
+#if defined(LL_TOOLKIT_LOCK_STATISTICS)
+    EXPECT_TRUE((std::is_same<LockStatisticsEnabled::LockCounters, LockCounters>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsEnabled::LockStatisticsRegistry, LockStatisticsRegistry>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsEnabled::Semaphore, Semaphore>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsEnabled::InstrumentedLock<>, InstrumentedLock<>>::value));
+#else
+    EXPECT_TRUE((std::is_same<LockStatisticsDisabled::LockCounters, LockCounters>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsDisabled::LockStatisticsRegistry, LockStatisticsRegistry>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsDisabled::Semaphore, Semaphore>::value));
+    EXPECT_TRUE((std::is_same<LockStatisticsDisabled::InstrumentedLock<>, InstrumentedLock<>>::value));
+#endif
+}
+
+} // namespace Common
@@ -0,0 +1,148 @@
+#include "common/Semaphore.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace Common {
+
+TEST(Semaphore, Counting)
+{
+    Semaphore semaphore(2);
+    EXPECT_EQ(2u, semaphore.getCount());
+
+    EXPECT_TRUE(semaphore.tryWait());
+    EXPECT_FALSE(semaphore.tryWait(2));
+    EXPECT_TRUE(semaphore.tryWait());
+    EXPECT_FALSE(semaphore.tryWait());
+
+    semaphore.notify(5);
+    EXPECT_EQ(3u, semaphore.tryWaitUpTo(3));
+    EXPECT_EQ(2u, semaphore.tryWaitUpTo(3));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(3));
+
+    semaphore.notify(3);
+    semaphore.wait(3);
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+TEST(Semaphore, ZeroMaxCount)
+{
+    Semaphore semaphore;
+    EXPECT_EQ(0u, semaphore.waitUpTo(0));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(0));
+
+    semaphore.notify(2);
+    EXPECT_EQ(0u, semaphore.waitUpTo(0));
+    EXPECT_EQ(0u, semaphore.tryWaitUpTo(0));
+    EXPECT_EQ(2u, semaphore.getCount());
+}
+
+TEST(Semaphore, Timeout)
+{
+    Semaphore semaphore;
+    EXPECT_FALSE(semaphore.waitFor(std::chrono::milliseconds(1)));
+    EXPECT_FALSE(semaphore.waitUntil(std::chrono::system_clock::now() + std::chrono::milliseconds(1)));
+
+    semaphore.notify();
+    EXPECT_FALSE(semaphore.waitFor(std::chrono::milliseconds(1), 2));
+    EXPECT_TRUE(semaphore.waitFor(std::chrono::milliseconds(1)));
+}
+
+TEST(Semaphore, WakeUpSleepingWaiters)
+{
+    Semaphore semaphore;
+
+    std::thread notifier([&semaphore] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        semaphore.notify(2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        semaphore.notify();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        semaphore.notify(4);
+    });
+
+    semaphore.wait(2);
+    EXPECT_TRUE(semaphore.waitFor(std::chrono::seconds(10)));
+    EXPECT_EQ(4u, semaphore.waitUpTo(10));
+
+    notifier.join();
+}
+
+TEST(Semaphore, SleepingWaitersShareNotifications)
+{
+    static const int waiterCount = 4;
+    static const int rounds = 20;
+
+    Semaphore semaphore;
+    std::atomic<int> acquired{0};
+
+    std::vector<std::thread> waiters;
+    for (int t = 0; t < waiterCount; ++t)
+    {
+        waiters.emplace_back([&] {
+            for (int round = 0; round < rounds; ++round)
+            {
+                semaphore.wait();
+                ++acquired;
+            }
+        });
+    }
+
+    // Let the waiters fall asleep, then wake them up a pair at a time
+    for (int round = 0; round < rounds; ++round)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int pair = 0; pair < waiterCount / 2; ++pair)
+        {
+            semaphore.notify(2);
+        }
+    }
+
+    for (auto& waiter : waiters)
+    {
+        waiter.join();
+    }
+
+    EXPECT_EQ(waiterCount * rounds, acquired.load());
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+TEST(Semaphore, ManyWaitersAndNotifiers)
+{
+    static const int threadCount = 4;
+    static const int countPerThread = 10000;
+
+    Semaphore semaphore;
+    std::atomic<int> acquired{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&] {
+            for (int i = 0; i < countPerThread; ++i)
+            {
+                semaphore.wait();
+                ++acquired;
+            }
+        });
+        threads.emplace_back([&] {
+            for (int i = 0; i < countPerThread; ++i)
+            {
+                semaphore.notify();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(threadCount * countPerThread, acquired.load());
+    EXPECT_EQ(0u, semaphore.getCount());
+}
+
+} // namespace Common
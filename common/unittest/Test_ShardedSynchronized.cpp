@@ -0,0 +1,123 @@
+#include "common/ShardedSynchronized.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Common {
+
+namespace {
+
+using Map = std::unordered_map<int, int>;
+
+} // anonymous namespace
+
+TEST(ShardedSynchronized, Transaction)
+{
+    ShardedSynchronized<Map> map;
+
+    map.makeTransaction(1)->emplace(1, 10);
+    {
+        auto shard = map.makeTransaction(2);
+        shard->emplace(2, 20);
+        shard->at(2) += 1;
+    }
+
+    EXPECT_EQ(10, std::as_const(map).makeTransaction(1)->at(1));
+    EXPECT_EQ(21, std::as_const(map).makeTransaction(2)->at(2));
+}
+
+TEST(ShardedSynchronized, KeysAreSpreadOverShards)
+{
+    ShardedSynchronized<Map, 8> map;
+
+    std::set<size_t> usedShards;
+    for (int key = 0; key < 64; ++key)
+    {
+        const size_t index = map.getShardIndex(key);
+        ASSERT_LT(index, 8u);
+        EXPECT_EQ(index, map.getShardIndex(key));
+        usedShards.insert(index);
+
+        map.makeTransaction(key)->emplace(key, key);
+        EXPECT_EQ(1u, std::as_const(map.getShard(index)).makeTransaction()->count(key));
+    }
+
+    EXPECT_EQ(8u, usedShards.size());
+}
+
+TEST(ShardedSynchronized, ForEachShard)
+{
+    ShardedSynchronized<std::unordered_map<std::string, int>, 4> map;
+    map.makeTransaction(std::string("a"))->emplace("a", 1);
+    map.makeTransaction(std::string("b"))->emplace("b", 2);
+    map.makeTransaction(std::string("c"))->emplace("c", 3);
+
+    map.forEachShard([](auto& shard) {
+        for (auto& entry : shard)
+        {
+            entry.second *= 10;
+        }
+    });
+
+    int sum = 0;
+    size_t shardCount = 0;
+    std::as_const(map).forEachShard([&](const auto& shard) {
+        ++shardCount;
+        for (const auto& entry : shard)
+        {
+            sum += entry.second;
+        }
+    });
+
+    EXPECT_EQ(4u, shardCount);
+    EXPECT_EQ(60, sum);
+}
+
+TEST(ShardedSynchronized, ShardConstructorArguments)
+{
+    ShardedSynchronized<Map, 4> map(32);
+
+    map.forEachShard([](const Map& shard) { EXPECT_LE(32u, shard.bucket_count()); });
+}
+
+TEST(ShardedSynchronized, ParallelWriters)
+{
+    static const int threadCount = 4;
+    static const int keysPerThread = 1000;
+
+    ShardedSynchronized<Map> map;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&map, t] {
+            for (int i = 0; i < keysPerThread; ++i)
+            {
+                const int key = t * keysPerThread + i;
+                map.makeTransaction(key)->emplace(key, t);
+                map.makeTransaction(key)->at(key) += 1;
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    size_t size = 0;
+    map.forEachShard([&size](const Map& shard) { size += shard.size(); });
+    EXPECT_EQ(static_cast<size_t>(threadCount * keysPerThread), size);
+
+    for (int t = 0; t < threadCount; ++t)
+    {
+        EXPECT_EQ(t + 1, map.makeTransaction(t * keysPerThread)->at(t * keysPerThread));
+    }
+}
+
+} // namespace Common
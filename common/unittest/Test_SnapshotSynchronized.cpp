@@ -0,0 +1,136 @@
+#include "common/SnapshotSynchronized.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Common {
+
+namespace {
+
+class Table
+{
+public:
+    Table(size_t size, int value) : values_(size, value) {}
+
+    void setAll(int value)
+    {
+        for (auto& v : values_)
+        {
+            v = value;
+        }
+    }
+
+    int get(size_t index) const { return values_.at(index); }
+
+    /** @return True if all values are the same */
+    bool isConsistent() const
+    {
+        return std::all_of(values_.begin(), values_.end(), [this](int v) { return v == values_.front(); });
+    }
+
+private:
+    std::vector<int> values_;
+};
+
+} // anonymous namespace
+
+TEST(SnapshotSynchronized, SingleCall)
+{
+    SnapshotSynchronized<Table> table(10, 1);
+    const auto& constTable = table;
+
+    EXPECT_EQ(1, constTable->get(5));
+    table->setAll(2);
+    EXPECT_EQ(2, constTable->get(5));
+}
+
+TEST(SnapshotSynchronized, SnapshotIsImmutable)
+{
+    SnapshotSynchronized<Table> table(10, 1);
+    const auto snapshot = std::as_const(table).makeTransaction();
+
+    {
+        auto transaction = table.makeTransaction();
+        transaction->setAll(2);
+
+        // Not visible before the transaction ends
+        EXPECT_EQ(1, std::as_const(table)->get(0));
+    }
+
+    EXPECT_EQ(1, snapshot->get(0));
+    EXPECT_EQ(2, std::as_const(table)->get(0));
+}
+
+TEST(SnapshotSynchronized, FailedTransactionIsNotPublished)
+{
+    SnapshotSynchronized<Table> table(10, 1);
+
+    EXPECT_THROW(
+        {
+            auto transaction = table.makeTransaction();
+            transaction->setAll(2);
+            (void)transaction->get(10); // Throws, leaving the copy changed
+        },
+        std::out_of_range);
+    EXPECT_EQ(1, std::as_const(table)->get(0));
+
+    // Lock released, and following transactions are published
+    EXPECT_THROW((void)table->get(10), std::out_of_range);
+    table->setAll(3);
+    EXPECT_EQ(3, std::as_const(table)->get(0));
+}
+
+TEST(SnapshotSynchronized, ReadersAreNotBlockedByWriter)
+{
+    SnapshotSynchronized<Table> table(10, 1);
+    auto transaction = table.makeTransaction();
+    transaction->setAll(2);
+
+    std::thread reader([&table] { EXPECT_EQ(1, std::as_const(table)->get(0)); });
+    reader.join();
+}
+
+TEST(SnapshotSynchronized, ParallelReadersAndWriters)
+{
+    static const int readerCount = 2;
+    static const int writerCount = 2;
+    static const int writesPerWriter = 1000;
+
+    SnapshotSynchronized<Table> table(100, 0);
+    std::atomic<int> writersDone{0};
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readerCount; ++r)
+    {
+        threads.emplace_back([&] {
+            while (writersDone != writerCount)
+            {
+                const auto snapshot = std::as_const(table).makeTransaction();
+                ASSERT_TRUE(snapshot->isConsistent());
+            }
+        });
+    }
+    for (int w = 0; w < writerCount; ++w)
+    {
+        threads.emplace_back([&, w] {
+            for (int i = 0; i < writesPerWriter; ++i)
+            {
+                table->setAll(w * writesPerWriter + i);
+            }
+            ++writersDone;
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_TRUE(std::as_const(table)->isConsistent());
+}
+
+} // namespace Common
@@ -1,7 +1,14 @@
 #include "common/Synchronized.hpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace Common {
 
@@ -29,6 +36,15 @@ public:
     MOCK_METHOD0(unlock, void());
 };
 
+class MockSharedLock
+{
+public:
+    MOCK_METHOD0(lock, void());
+    MOCK_METHOD0(unlock, void());
+    MOCK_METHOD0(lock_shared, void());
+    MOCK_METHOD0(unlock_shared, void());
+};
+
 class MockData
 {
 public:
@@ -53,6 +69,13 @@ private:
     testing::NiceMock<MockLock> lock_;
 };
 
+// SeqLock copies the snapshot into a default constructed value
+class MockSnapshotData : public MockData
+{
+public:
+    MockSnapshotData(int initialData = 0) : MockData(initialData) {}
+};
+
 class MockDataWithCustomLock : public MockData
 {
 public:
@@ -195,4 +218,225 @@ TEST(TestSynchronized, testCopy)
     EXPECT_EQ(55, data->getData());
 }
 
+TEST(TestSynchronized, testSharedLock)
+{
+    testing::StrictMock<MockSharedLock> lock;
+    Synchronized<MockData, ExternalSharedLock<MockSharedLock>> data(ExternalSharedLock<MockSharedLock>(lock), 33);
+    const auto& constData = data;
+
+    testing::InSequence sequence;
+    EXPECT_CALL(lock, lock_shared());
+    EXPECT_CALL(lock, unlock_shared());
+    EXPECT_CALL(lock, lock());
+    EXPECT_CALL(lock, unlock());
+    EXPECT_CALL(lock, lock_shared());
+    EXPECT_CALL(lock, unlock_shared());
+
+    EXPECT_EQ(33, constData->getData());
+    data->setData(22);
+    EXPECT_EQ(22, constData.makeTransaction()->getData());
+}
+
+TEST(TestSynchronized, testParallelConstTransactions)
+{
+    const Synchronized<const MockData, InternalSharedLock<>> data(11);
+    std::atomic<int> readers{0};
+
+    const auto read = [&] {
+        auto transaction = data.makeTransaction();
+        ++readers;
+
+        // Both readers hold the lock at the same time
+        const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (readers != 2 && std::chrono::steady_clock::now() < timeout)
+        {
+            std::this_thread::yield();
+        }
+
+        EXPECT_EQ(2, readers.load());
+        EXPECT_EQ(11, transaction->getData());
+    };
+
+    std::thread reader(read);
+    read();
+    reader.join();
+}
+
+TEST(TestSynchronized, testSpinLock)
+{
+    static const int threadCount = 4;
+    static const int countPerThread = 10000;
+
+    Synchronized<MockData, InternalSpinLock<>> data(0);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&data] {
+            for (int i = 0; i < countPerThread; ++i)
+            {
+                auto transaction = data.makeTransaction();
+                transaction->setData(transaction->getData() + 1);
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(threadCount * countPerThread, data->getData());
+}
+
+namespace {
+
+struct Pair
+{
+    Pair() : Pair(0) {}
+    Pair(int64_t value) : first_(value), second_(value) {}
+    void set(int64_t value)
+    {
+        first_ = value;
+        second_ = value;
+    }
+    bool isConsistent() const { return first_ == second_; }
+
+    int64_t first_;
+    int64_t second_;
+};
+
+} // anonymous namespace
+
+TEST(TestSynchronized, testSeqLock)
+{
+    Synchronized<MockSnapshotData, SeqLock<MockSnapshotData>> data(5);
+    const auto& constData = data;
+    EXPECT_EQ(5, constData->getData());
+
+    data->setData(6);
+    EXPECT_EQ(6, constData->getData());
+
+    // Snapshot is not affected by later writes
+    auto snapshot = constData.makeTransaction();
+    data->setData(7);
+    EXPECT_EQ(6, snapshot->getData());
+    EXPECT_EQ(7, constData->getData());
+}
+
+TEST(TestSynchronized, testSeqLockParallelReaders)
+{
+    static const int readerCount = 3;
+    static const int64_t writeCount = 100000;
+
+    Synchronized<Pair, SeqLock<Pair>> data(0);
+    const auto& constData = data;
+    std::atomic<bool> writing{true};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < readerCount; ++r)
+    {
+        readers.emplace_back([&] {
+            int64_t previous = 0;
+            while (writing)
+            {
+                auto snapshot = constData.makeTransaction();
+                ASSERT_TRUE(snapshot->isConsistent());
+                ASSERT_LE(previous, snapshot->first_);
+                previous = snapshot->first_;
+            }
+        });
+    }
+
+    for (int64_t i = 1; i <= writeCount; ++i)
+    {
+        data->set(i);
+    }
+    writing = false;
+
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(writeCount, constData->first_);
+}
+
+TEST(TestSynchronized, testSynchronizeLocksInAddressOrder)
+{
+    testing::StrictMock<MockLock> lock1;
+    testing::StrictMock<MockLock> lock2;
+    Synchronized<MockData, ExternalLock<MockLock>> data[2] = {
+        {ExternalLock<MockLock>(lock1), 1}, {ExternalLock<MockLock>(lock2), 2}};
+
+    // Unlocking order is up to the tuple destructor
+    testing::Sequence locking;
+    EXPECT_CALL(lock1, lock()).InSequence(locking);
+    EXPECT_CALL(lock2, lock()).InSequence(locking);
+    EXPECT_CALL(lock1, unlock());
+    EXPECT_CALL(lock2, unlock());
+
+    auto [second, first] = synchronize(data[1], data[0]);
+    EXPECT_EQ(2, second->getData());
+    EXPECT_EQ(1, first->getData());
+}
+
+TEST(TestSynchronized, testSynchronizeUnlocksWhenLockingThrows)
+{
+    testing::StrictMock<MockLock> lock1;
+    testing::StrictMock<MockLock> lock2;
+    testing::StrictMock<MockLock> lock3;
+    Synchronized<MockData, ExternalLock<MockLock>> data[3] = {
+        {ExternalLock<MockLock>(lock1), 1}, {ExternalLock<MockLock>(lock2), 2}, {ExternalLock<MockLock>(lock3), 3}};
+
+    // The second lock fails, the first one is released and the third one never taken
+    testing::Sequence locking;
+    EXPECT_CALL(lock1, lock()).InSequence(locking);
+    EXPECT_CALL(lock2, lock()).InSequence(locking).WillOnce(testing::Throw(std::runtime_error("lock failed")));
+    EXPECT_CALL(lock1, unlock()).InSequence(locking);
+
+    EXPECT_THROW(synchronize(data[2], data[0], data[1]), std::runtime_error);
+}
+
+TEST(TestSynchronized, testSynchronizeConstObject)
+{
+    testing::StrictMock<MockLock> lock;
+    testing::StrictMock<MockSharedLock> sharedLock;
+    Synchronized<MockData, ExternalLock<MockLock>> target(ExternalLock<MockLock>(lock), 0);
+    Synchronized<MockData, ExternalSharedLock<MockSharedLock>> source(
+        ExternalSharedLock<MockSharedLock>(sharedLock), 5);
+
+    EXPECT_CALL(lock, lock());
+    EXPECT_CALL(lock, unlock());
+    EXPECT_CALL(sharedLock, lock_shared());
+    EXPECT_CALL(sharedLock, unlock_shared());
+
+    auto [t, s] = synchronize(target, std::as_const(source));
+    t->setData(s->getData());
+    EXPECT_EQ(5, t->getData());
+}
+
+TEST(TestSynchronized, testSynchronizeInOppositeOrders)
+{
+    static const int countPerThread = 10000;
+
+    Synchronized<MockData> a(1000);
+    Synchronized<MockData> b(1000);
+
+    const auto transfer = [](Synchronized<MockData>& from, Synchronized<MockData>& to) {
+        for (int i = 0; i < countPerThread; ++i)
+        {
+            auto [f, t] = synchronize(from, to);
+            f->setData(f->getData() - 1);
+            t->setData(t->getData() + 1);
+        }
+    };
+
+    std::thread thread(transfer, std::ref(a), std::ref(b));
+    transfer(b, a);
+    thread.join();
+
+    auto [x, y] = synchronize(std::as_const(a), std::as_const(b));
+    EXPECT_EQ(2000, x->getData() + y->getData());
+}
+
 } // namespace Common
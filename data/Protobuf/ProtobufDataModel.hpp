@@ -22,6 +22,7 @@ public:
      * @{
      */
     virtual void set(const DataType& data) override;
+    virtual void set(DataType&& data) override;
     virtual const DataType& get() const override;
     virtual Publisher<DataType>& publisher() override;
 
@@ -54,6 +55,11 @@ void ProtobufDataModel<DataType, Less>::set(const DataType& data)
     serializableModel_.set(data);
 }
 template <typename DataType, typename Less>
+void ProtobufDataModel<DataType, Less>::set(DataType&& data)
+{
+    serializableModel_.set(std::move(data));
+}
+template <typename DataType, typename Less>
 const DataType& ProtobufDataModel<DataType, Less>::get() const
 {
     return serializableModel_.get();
@@ -0,0 +1,92 @@
+#include "data/HeterogeneousRingBuffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+/**
+ * Throughput of HeterogeneousRingBuffer with one writer and one reader thread.
+ *
+ * Small buffers keep both threads working on the same few cache lines, which shows the
+ * cost of sharing state between the threads. Bigger buffers let the threads run further apart.
+ *
+ * Each size is measured with the default CacheLineLayout and with PackedLayout, which keeps
+ * the writer, reader and shared state next to each other, to show the effect of the layout.
+ * The layouts are measured in alternating rounds, so both see the same machine conditions.
+ */
+namespace {
+
+constexpr int ELEMENT_COUNT = 2000000;
+constexpr int ROUNDS = 5;
+
+template <size_t BYTES, typename Sync, typename Layout>
+double measureNanosecondsPerElement()
+{
+    using Buffer = Data::HeterogeneousRingBuffer<int64_t, BYTES, Sync, Layout>;
+    auto buffer = std::make_unique<Buffer>();
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&buffer] {
+        for (int i = 0; i < ELEMENT_COUNT; ++i)
+        {
+            buffer->enqueue(int64_t{i});
+        }
+    });
+
+    int64_t sum = 0;
+    for (int i = 0; i < ELEMENT_COUNT; ++i)
+    {
+        sum += buffer->dequeue();
+    }
+    producer.join();
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    if (sum != int64_t{ELEMENT_COUNT} * (ELEMENT_COUNT - 1) / 2)
+        std::cerr << "Unexpected sum: " << sum << std::endl;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ELEMENT_COUNT;
+}
+
+template <size_t BYTES, typename Sync>
+void benchmark(const char* syncName)
+{
+    double bestCacheLine = measureNanosecondsPerElement<BYTES, Sync, Data::CacheLineLayout>();
+    double bestPacked = measureNanosecondsPerElement<BYTES, Sync, Data::PackedLayout>();
+    for (int round = 1; round < ROUNDS; ++round)
+    {
+        bestCacheLine = std::min(bestCacheLine, measureNanosecondsPerElement<BYTES, Sync, Data::CacheLineLayout>());
+        bestPacked = std::min(bestPacked, measureNanosecondsPerElement<BYTES, Sync, Data::PackedLayout>());
+    }
+
+    std::cout << std::setw(14) << syncName << std::setw(10) << BYTES << std::fixed << std::setprecision(1)
+              << std::setw(12) << bestCacheLine << std::setw(12) << bestPacked << std::setprecision(2)
+              << std::setw(10) << bestPacked / bestCacheLine << std::endl;
+}
+
+template <typename Sync>
+void benchmarkSizes(const char* syncName)
+{
+    benchmark<256, Sync>(syncName);
+    benchmark<1024, Sync>(syncName);
+    benchmark<4096, Sync>(syncName);
+    benchmark<65536, Sync>(syncName);
+}
+
+} // anonymous namespace
+
+int main()
+{
+    std::cout << "ns/element with the cache line and packed layouts, and their ratio" << std::endl;
+    std::cout << std::setw(14) << "Sync" << std::setw(10) << "BYTES" << std::setw(12) << "CacheLine" << std::setw(12)
+              << "Packed" << std::setw(10) << "Ratio" << std::endl;
+
+    benchmarkSizes<Data::SemaphoreSync>("SemaphoreSync");
+    benchmarkSizes<Data::LockFreeSync>("LockFreeSync");
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "ExecutorIf.hpp"
+#include "Publisher.hpp"
+#include "common/Delegate.hpp"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace Data {
+
+/** Check whether @p DataType can merge a later value into itself with coalesce */
+///@{
+template <typename DataType, typename = void>
+struct can_coalesce : std::false_type
+{
+};
+template <typename DataType>
+struct can_coalesce<DataType, std::void_t<decltype(&DataType::coalesce)>> : std::true_type
+{
+};
+///@}
+
+/** How an AsyncSubscriber delivers the notifications */
+enum class Delivery
+{
+    Every,  ///< Every notified value is delivered
+    Latest, ///< Values notified while a delivery is pending are coalesced, only the latest is delivered
+};
+
+/**
+ * Subscription delivering the notifications of a Publisher asynchronously with an executor.
+ *
+ * Notifying only copies the data and posts a task, so a slow subscriber does not stall the notifier.
+ * The callback runs in the executor thread. Deliveries of one subscription never run concurrently,
+ * and with Delivery::Every they are in notification order if the executor runs tasks in order,
+ * like ThreadExecutor with a single thread. With Delivery::Latest, types having coalesce, like
+ * MapDataModel::Delta, merge the later values into the pending one instead of replacing it.
+ *
+ * The executor needs to outlive the subscription.
+ *
+ * An exception thrown by the callback is logged and dropped, and the delivery continues with the
+ * next value. If copying a value or posting a delivery task fails, the exception propagates to the
+ * notifier or the executor, and the values still queued are delivered after the next notification.
+ *
+ * Example:
+ *
+ *   ThreadExecutor executor;
+ *   AsyncSubscriber<Status> subscription(model.publisher(), executor,
+ *                                        Common::Delegate<void(const Status&)>::fromMember(view, &View::show),
+ *                                        Delivery::Latest);
+ *
+ * @tparam DataType The data type
+ */
+template <typename DataType>
+class AsyncSubscriber
+{
+public:
+    using Callback = Common::Delegate<void(const DataType&)>;
+
+    /** Subscribe to @p publisher to deliver its notifications to @p callback with @p executor */
+    AsyncSubscriber(Publisher<DataType>& publisher, ExecutorIf& executor, Callback callback, Delivery delivery);
+
+    /**
+     * Unsubscribe and wait for the notifications in progress and the pending deliveries.
+     * Must not be destroyed from a notification of the publisher.
+     */
+    ~AsyncSubscriber();
+
+    /** Prevent copy, assignment and move */
+    AsyncSubscriber(const AsyncSubscriber&) = delete;
+    AsyncSubscriber& operator=(const AsyncSubscriber&) = delete;
+    AsyncSubscriber& operator=(AsyncSubscriber&&) = delete;
+
+private:
+    /** Publisher callback, queues the data for delivery */
+    void notify(const DataType& data);
+
+    /** Deliver the next queued value */
+    void deliver();
+
+    /** Post a task to deliver the next queued value */
+    void postDelivery();
+
+    /** Mark the delivery as finished. Needs mutex_. */
+    void endDelivery();
+
+    Publisher<DataType>& publisher_;
+    ExecutorIf& executor_;
+    const Callback callback_;
+    const Delivery delivery_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_; ///< Notified when there are no delivery tasks left
+    std::deque<DataType> queued_;  ///< Values to deliver, at most one when coalescing. Needs mutex_.
+    bool delivering_;              ///< True while a delivery task is posted or running. Needs mutex_.
+};
+
+template <typename DataType>
+AsyncSubscriber<DataType>::AsyncSubscriber(Publisher<DataType>& publisher,
+                                           ExecutorIf& executor,
+                                           Callback callback,
+                                           Delivery delivery)
+  : publisher_(publisher),
+    executor_(executor),
+    callback_(callback),
+    delivery_(delivery),
+    mutex_(),
+    idle_(),
+    queued_(),
+    delivering_(false)
+{
+    publisher_.subscribe(*this, &AsyncSubscriber::notify);
+}
+
+template <typename DataType>
+AsyncSubscriber<DataType>::~AsyncSubscriber()
+{
+    publisher_.unsubscribe(*this);
+    publisher_.waitForNotifications(); // Notifications in other threads may still be calling notify
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    idle_.wait(lock, [this] { return !delivering_; });
+}
+
+template <typename DataType>
+void AsyncSubscriber<DataType>::notify(const DataType& data)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+
+        if (delivery_ == Delivery::Latest && !queued_.empty())
+        {
+            if constexpr (can_coalesce<DataType>::value)
+                queued_.back().coalesce(data);
+            else
+                queued_.back() = data;
+        }
+        else
+            queued_.push_back(data);
+
+        if (delivering_)
+            return; // Delivered by the pending task
+
+        delivering_ = true;
+    }
+
+    try
+    {
+        postDelivery();
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        endDelivery();
+        throw;
+    }
+}
+
+template <typename DataType>
+void AsyncSubscriber<DataType>::deliver()
+{
+    /** Ends the delivery unless it is handed over to the next task, also when this one fails */
+    class DeliveryEnd
+    {
+    public:
+        DeliveryEnd(AsyncSubscriber& subscriber, std::unique_lock<std::mutex>& lock)
+          : subscriber_(subscriber),
+            lock_(lock),
+            handedOver_(false)
+        {
+        }
+        ~DeliveryEnd()
+        {
+            if (handedOver_)
+                return;
+            if (!lock_.owns_lock())
+                lock_.lock();
+            subscriber_.endDelivery();
+        }
+
+        void handOver() { handedOver_ = true; }
+
+    private:
+        AsyncSubscriber& subscriber_;
+        std::unique_lock<std::mutex>& lock_;
+        bool handedOver_;
+    };
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    DeliveryEnd deliveryEnd{*this, lock};
+
+    const DataType data = std::move(queued_.front());
+    queued_.pop_front();
+
+    lock.unlock();
+    try
+    {
+        callback_(data);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "AsyncSubscriber callback failed: " << e.what() << std::endl;
+    }
+    catch (...)
+    {
+        std::cerr << "AsyncSubscriber callback failed" << std::endl;
+    }
+    lock.lock();
+
+    if (queued_.empty())
+        return; // Ended by deliveryEnd while still locked, so a notification can't slip in between
+
+    // One value per task, so a busy subscriber doesn't hog the executor threads
+    lock.unlock();
+    postDelivery();
+    deliveryEnd.handOver();
+}
+
+template <typename DataType>
+void AsyncSubscriber<DataType>::postDelivery()
+{
+    executor_.post([this] { deliver(); });
+}
+
+template <typename DataType>
+void AsyncSubscriber<DataType>::endDelivery()
+{
+    delivering_ = false;
+    idle_.notify_all();
+}
+
+} // namespace Data
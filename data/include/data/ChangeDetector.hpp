@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+namespace Data {
+
+/**
+ * DataModel change detection policies.
+ *
+ * A policy implements:
+ * - bool differs(const DataType& current, const DataType& data), telling whether @p data differs from
+ *   the current model value. May remember what it learned about @p data.
+ * - void accepted(const DataType& current), called when the data last given to differs became
+ *   the current value.
+ * - void reset(const DataType& current), called when the current value was set or modified otherwise.
+ */
+///@{
+
+/** Detects changes with two Less comparisons, works with any strictly ordered type */
+template <typename DataType, typename Less = std::less<DataType>>
+class LessChangeDetector
+{
+public:
+    bool differs(const DataType& current, const DataType& data) const
+    {
+        const Less less{};
+        return less(current, data) || less(data, current);
+    }
+    void accepted(const DataType&) {}
+    void reset(const DataType&) {}
+};
+
+/** Detects changes with a single equality comparison */
+template <typename DataType, typename Equal = std::equal_to<DataType>>
+class EqualChangeDetector
+{
+public:
+    bool differs(const DataType& current, const DataType& data) const { return !Equal{}(current, data); }
+    void accepted(const DataType&) {}
+    void reset(const DataType&) {}
+};
+
+/**
+ * Detects changes by comparing the hash of the new data with the cached hash of the current value,
+ * so the current value is not read at all when the hashes differ. Equal hashes are confirmed with
+ * Equal. Pays off when hashing is cheaper than comparing, or most updates are changes.
+ */
+template <typename DataType, typename Hash = std::hash<DataType>, typename Equal = std::equal_to<DataType>>
+class HashChangeDetector
+{
+public:
+    HashChangeDetector() : currentHash_(0), candidateHash_(0) {}
+
+    bool differs(const DataType& current, const DataType& data)
+    {
+        candidateHash_ = Hash{}(data);
+        return candidateHash_ != currentHash_ || !Equal{}(current, data);
+    }
+    void accepted(const DataType&) { currentHash_ = candidateHash_; }
+    void reset(const DataType& current) { currentHash_ = Hash{}(current); }
+
+private:
+    size_t currentHash_;
+    size_t candidateHash_; ///< Hash of the data last given to differs
+};
+
+/** Check whether @p DataType has operator== */
+///@{
+template <typename DataType, typename = void>
+struct is_equality_comparable : std::false_type
+{
+};
+template <typename DataType>
+struct is_equality_comparable<DataType,
+                              std::void_t<decltype(std::declval<const DataType&>() == std::declval<const DataType&>())>>
+  : std::true_type
+{
+};
+///@}
+
+/** Equality comparison if available and no custom Less is given, Less comparisons otherwise */
+template <typename DataType, typename Less = std::less<DataType>>
+using DefaultChangeDetector =
+    std::conditional_t<std::is_same<Less, std::less<DataType>>::value && is_equality_comparable<DataType>::value,
+                       EqualChangeDetector<DataType>,
+                       LessChangeDetector<DataType, Less>>;
+
+///@}
+
+} // namespace Data
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "common/Semaphore.hpp"
+#include <chrono>
 #include <deque>
+#include <mutex>
+#include <string>
 
 namespace Data {
 
@@ -20,6 +23,9 @@ public:
     ConcreteQueue();
     virtual ~ConcreteQueue();
 
+    /** Record waits for elements under @p name, see Common::LockStatisticsRegistry */
+    void setName(const std::string& name);
+
     /** Put (a copy of) a new @p element to the end of the queue. */
     void enqueue(const T& element);
 
@@ -33,6 +39,32 @@ public:
      */
     const T& dequeue();
 
+    /**
+     * Fetch the next element from the queue if there is one.
+     *
+     * @return Pointer to the element or nullptr if the queue is empty.
+     *         The pointer is valid until next call to any of the dequeue methods.
+     */
+    const T* tryDequeue();
+
+    /**
+     * Fetch the next element from the queue, waiting for a @p duration
+     * if there are no queued elements.
+     *
+     * @return Pointer to the element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Rep, class Period>
+    const T* dequeueFor(const std::chrono::duration<Rep, Period>& duration);
+
+    /**
+     * Fetch the next element from the queue, waiting until a @p timePoint
+     * if there are no queued elements.
+     *
+     * @return Pointer to the element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Clock, class Duration>
+    const T* dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+
 private:
     // Non-copyable
     // TODO: Could be made copyable as all elements are there by value.
@@ -40,6 +72,12 @@ private:
     ConcreteQueue(const ConcreteQueue&) = delete;
     ConcreteQueue& operator=(const ConcreteQueue&) = delete;
 
+    /** Release previously dequeued element, if any */
+    void releaseDequeuedElement();
+
+    /** @return Pointer to the front element, now dequeued, or nullptr if the queue is empty */
+    const T* dequeueFront();
+
     std::deque<T> queue_;
     const T* dequeuedElement_;
     Common::Semaphore semaphore_;
@@ -56,6 +94,12 @@ ConcreteQueue<T>::~ConcreteQueue()
 {
 }
 
+template <typename T>
+void ConcreteQueue<T>::setName(const std::string& name)
+{
+    semaphore_.setName(name);
+}
+
 template <typename T>
 void ConcreteQueue<T>::enqueue(const T& element)
 {
@@ -81,23 +125,68 @@ bool ConcreteQueue<T>::isEmpty() const
 
 template <typename T>
 const T& ConcreteQueue<T>::dequeue()
+{
+    releaseDequeuedElement();
+
+    const T* element = dequeueFront();
+    while (!element)
+    {
+        semaphore_.wait();
+        element = dequeueFront();
+    }
+
+    return *element;
+}
+
+template <typename T>
+const T* ConcreteQueue<T>::tryDequeue()
+{
+    releaseDequeuedElement();
+    return dequeueFront();
+}
+
+template <typename T>
+template <class Rep, class Period>
+const T* ConcreteQueue<T>::dequeueFor(const std::chrono::duration<Rep, Period>& duration)
+{
+    return dequeueUntil(std::chrono::steady_clock::now() + duration);
+}
+
+template <typename T>
+template <class Clock, class Duration>
+const T* ConcreteQueue<T>::dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    releaseDequeuedElement();
+
+    const T* element = dequeueFront();
+    while (!element && semaphore_.waitUntil(timePoint))
+    {
+        element = dequeueFront();
+    }
+
+    return element;
+}
+
+template <typename T>
+void ConcreteQueue<T>::releaseDequeuedElement()
 {
     if (dequeuedElement_)
     {
-        // Release previously dequeued element
         std::lock_guard<std::mutex> lock{mutex_};
         queue_.pop_front();
         dequeuedElement_ = nullptr;
     }
+}
 
-    while (queue_.empty())
-    {
-        semaphore_.wait();
-    }
-
+template <typename T>
+const T* ConcreteQueue<T>::dequeueFront()
+{
     std::lock_guard<std::mutex> lock{mutex_};
+    if (queue_.empty())
+        return nullptr;
+
     dequeuedElement_ = &queue_.front();
-    return *dequeuedElement_;
+    return dequeuedElement_;
 }
 
 } // namespace Data
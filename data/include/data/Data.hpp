@@ -37,6 +37,13 @@ public:
      */
     void set(const DataType& data) override;
 
+    /**
+     * Set model value by moving
+     *
+     * @param data New value
+     */
+    void set(DataType&& data) override;
+
     /**
      * @return Model value
      */
@@ -73,6 +80,12 @@ void Data<DataType>::set(const DataType& data)
     data_ = data;
 }
 
+template <typename DataType>
+void Data<DataType>::set(DataType&& data)
+{
+    data_ = std::move(data);
+}
+
 template <typename DataType>
 const DataType& Data<DataType>::get() const
 {
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "ChangeDetector.hpp"
 #include "DataModelIf.hpp"
 #include "Publisher.hpp"
 #include <functional>
+#include <optional>
+#include <type_traits>
 #include <utility>
 
 namespace Data {
@@ -14,9 +17,16 @@ namespace Data {
  *
  * Not thread-safe.
  *
+ * A new value is published only if it differs from the current one, as told by @p ChangeDetector.
+ * By default operator== is used if available, and Less otherwise, see ChangeDetector.hpp.
+ *
  * @tparam DataType Data type
+ * @tparam Less Ordering used for change detection when the type has no operator==
+ * @tparam ChangeDetector Change detection policy
  */
-template <typename DataType, typename Less = std::less<DataType>>
+template <typename DataType,
+          typename Less = std::less<DataType>,
+          typename ChangeDetector = DefaultChangeDetector<DataType, Less>>
 class DataModel : public DataModelIf<DataType>
 {
 public:
@@ -47,6 +57,33 @@ public:
      */
     void set(const DataType& data) override;
 
+    /**
+     * Set model value by moving
+     *
+     * @param data New value
+     */
+    void set(DataType&& data) override;
+
+    /**
+     * Set model value to one constructed from @p args
+     *
+     * @param args Constructor arguments
+     */
+    template <typename... Args>
+    void emplace(Args&&... args);
+
+    /**
+     * Modify model value in place with @p fn and publish it.
+     *
+     * No copy is made, so the change can't be detected by comparing. If @p fn returns bool,
+     * the value is published only when it returns true, otherwise it is always published.
+     * If @p fn throws, the value is taken as changed and left unpublished.
+     *
+     * @param fn Function taking the value as DataType&
+     */
+    template <typename Fn>
+    void modify(Fn fn);
+
     /**
      * @return Model value
      */
@@ -55,84 +92,222 @@ public:
     /** @return publisher */
     Publisher<DataType>& publisher() override;
 
-    /** Set internal model value to @p data, but do not publish the change. */
+    /**
+     * Set internal model value to @p data, but do not publish the change.
+     *
+     * @param data New value
+     */
     void setInternal(const DataType& data);
+    void setInternal(DataType&& data);
+
+    /**
+     * Keep a copy of the published value on the next unpublished change, until publishPendingChanges,
+     * so that a value set back to it is not published at all. Used by ModelBatch.
+     *
+     * Costs a copy and a comparison of the whole value, so plain setInternal doesn't do it.
+     */
+    void keepPublishedValue();
 
-    /** Publish any pending (unpublished) changes to the model. If there are no pending changes, does nothing. */
+    /**
+     * Publish any pending (unpublished) changes to the model. If there are no pending changes,
+     * or the value was set back to the one kept by keepPublishedValue, does nothing.
+     */
     void publishPendingChanges();
 
 private:
+    /** Set data_ to @p data if it differs, and mark it unpublished */
+    template <typename Data>
+    void assign(Data&& data);
+
     /** Model data */
     DataType data_;
 
+    /** Value before the first unpublished change, if asked for with keepPublishedValue */
+    std::optional<DataType> publishedValue_;
+
+    /** True from keepPublishedValue until the next publication */
+    bool keepPublishedValue_;
+
     /** Publisher */
     Publisher<DataType> publisher_;
 
+    /** Tells whether a new value differs from data_ */
+    ChangeDetector changeDetector_;
+
     /** True if internal state has been changed since previous publish. @see setInternal */
     bool hasUnpublishedChanges_;
 };
 
-template <typename DataType, typename Less>
-DataModel<DataType, Less>::DataModel() : data_{}, publisher_{}, hasUnpublishedChanges_{false}
+template <typename DataType, typename Less, typename ChangeDetector>
+DataModel<DataType, Less, ChangeDetector>::DataModel()
+  : data_{},
+    publishedValue_{},
+    keepPublishedValue_{false},
+    publisher_{},
+    changeDetector_{},
+    hasUnpublishedChanges_{false}
 {
+    changeDetector_.reset(data_);
 }
 
-template <typename DataType, typename Less>
-DataModel<DataType, Less>::DataModel(const DataType& data) : data_(data), publisher_{}, hasUnpublishedChanges_{false}
+template <typename DataType, typename Less, typename ChangeDetector>
+DataModel<DataType, Less, ChangeDetector>::DataModel(const DataType& data)
+  : data_(data),
+    publishedValue_{},
+    keepPublishedValue_{false},
+    publisher_{},
+    changeDetector_{},
+    hasUnpublishedChanges_{false}
 {
+    changeDetector_.reset(data_);
 }
 
-template <typename DataType, typename Less>
-DataModel<DataType, Less>::DataModel(DataType&& data)
-  : data_{std::forward<DataType>(data)}, publisher_{}, hasUnpublishedChanges_{false}
+template <typename DataType, typename Less, typename ChangeDetector>
+DataModel<DataType, Less, ChangeDetector>::DataModel(DataType&& data)
+  : data_{std::forward<DataType>(data)},
+    publishedValue_{},
+    keepPublishedValue_{false},
+    publisher_{},
+    changeDetector_{},
+    hasUnpublishedChanges_{false}
 {
+    changeDetector_.reset(data_);
 }
 
-template <typename DataType, typename Less>
-DataModel<DataType, Less>::~DataModel()
+template <typename DataType, typename Less, typename ChangeDetector>
+DataModel<DataType, Less, ChangeDetector>::~DataModel()
 {
 }
 
-template <typename DataType, typename Less>
-void DataModel<DataType, Less>::set(const DataType& data)
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::set(const DataType& data)
 {
-    setInternal(data);
+    assign(data);
     publishPendingChanges();
 }
 
-template <typename DataType, typename Less>
-const DataType& DataModel<DataType, Less>::get() const
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::set(DataType&& data)
+{
+    assign(std::move(data));
+    publishPendingChanges();
+}
+
+template <typename DataType, typename Less, typename ChangeDetector>
+template <typename... Args>
+void DataModel<DataType, Less, ChangeDetector>::emplace(Args&&... args)
+{
+    set(DataType(std::forward<Args>(args)...));
+}
+
+template <typename DataType, typename Less, typename ChangeDetector>
+template <typename Fn>
+void DataModel<DataType, Less, ChangeDetector>::modify(Fn fn)
+{
+    /** Keeps following data_ if fn fails, as it may have changed data_ part way */
+    class FailedModification
+    {
+    public:
+        explicit FailedModification(DataModel& model) : model_(model), succeeded_(false) {}
+        ~FailedModification()
+        {
+            if (succeeded_)
+                return;
+            model_.changeDetector_.reset(model_.data_);
+            model_.hasUnpublishedChanges_ = true;
+        }
+
+        void succeed() { succeeded_ = true; }
+
+    private:
+        DataModel& model_;
+        bool succeeded_;
+    };
+
+    FailedModification failure{*this};
+    if constexpr (std::is_same<decltype(fn(data_)), bool>::value)
+    {
+        if (fn(data_))
+            hasUnpublishedChanges_ = true;
+    }
+    else
+    {
+        fn(data_);
+        hasUnpublishedChanges_ = true;
+    }
+    failure.succeed();
+
+    changeDetector_.reset(data_);
+    publishedValue_.reset(); // Published as told by fn
+
+    publishPendingChanges();
+}
+
+template <typename DataType, typename Less, typename ChangeDetector>
+const DataType& DataModel<DataType, Less, ChangeDetector>::get() const
 {
     return data_;
 }
 
-template <typename DataType, typename Less>
-Publisher<DataType>& DataModel<DataType, Less>::publisher()
+template <typename DataType, typename Less, typename ChangeDetector>
+Publisher<DataType>& DataModel<DataType, Less, ChangeDetector>::publisher()
 {
     return publisher_;
 }
 
-template <typename DataType, typename Less>
-void DataModel<DataType, Less>::setInternal(const DataType& data)
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::setInternal(const DataType& data)
+{
+    assign(data);
+}
+
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::setInternal(DataType&& data)
 {
-    const Less less{};
-    const bool differ = less(data_, data) || less(data, data_);
+    assign(std::move(data));
+}
 
-    if (differ)
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::keepPublishedValue()
+{
+    keepPublishedValue_ = true;
+}
+
+template <typename DataType, typename Less, typename ChangeDetector>
+void DataModel<DataType, Less, ChangeDetector>::publishPendingChanges()
+{
+    keepPublishedValue_ = false;
+    if (!hasUnpublishedChanges_)
+        return;
+
+    hasUnpublishedChanges_ = false;
+    if (publishedValue_)
     {
-        data_ = data;
-        hasUnpublishedChanges_ = true;
+        // Compared as a new value to the current one, so the detector's view of data_ stays valid
+        const bool reverted = !changeDetector_.differs(data_, *publishedValue_);
+        publishedValue_.reset();
+        if (reverted)
+            return;
     }
+    publisher_.notifySubscribers(data_);
 }
 
-template <typename DataType, typename Less>
-void DataModel<DataType, Less>::publishPendingChanges()
+template <typename DataType, typename Less, typename ChangeDetector>
+template <typename Data>
+void DataModel<DataType, Less, ChangeDetector>::assign(Data&& data)
 {
-    if (hasUnpublishedChanges_)
+    if (!changeDetector_.differs(data_, data))
+        return;
+
+    if constexpr (std::is_copy_constructible<DataType>::value)
     {
-        hasUnpublishedChanges_ = false;
-        publisher_.notifySubscribers(data_);
+        if (keepPublishedValue_ && !hasUnpublishedChanges_)
+            publishedValue_.emplace(data_);
     }
+
+    data_ = std::forward<Data>(data);
+    changeDetector_.accepted(data_);
+    hasUnpublishedChanges_ = true;
 }
 
 } // namespace Data
@@ -10,6 +10,9 @@ public:
     /** Write @p data */
     virtual void set(const DataType& data) = 0;
 
+    /** Write @p data, moving it if the implementation supports it */
+    virtual void set(DataType&& data) { set(static_cast<const DataType&>(data)); }
+
     virtual ~DataWriteIf() {}
 
 protected:
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+
+namespace Data {
+
+/** Interface to run tasks asynchronously */
+class ExecutorIf
+{
+public:
+    /** Run @p task later, in some thread of the executor */
+    virtual void post(std::function<void()> task) = 0;
+
+    virtual ~ExecutorIf() {}
+
+protected:
+    ExecutorIf() {}
+
+private:
+    /** Non-copyable */
+    ExecutorIf(const ExecutorIf&) = delete;
+    ExecutorIf& operator=(const ExecutorIf&) = delete;
+};
+
+} // namespace Data
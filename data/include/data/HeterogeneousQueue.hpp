@@ -1,24 +1,49 @@
 #pragma once
 
 #include "common/Semaphore.hpp"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
-#include <iostream>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace Data {
 
+/**
+ * Reuse of memory blocks in HeterogeneousQueue.
+ *
+ * Blocks the reader is done with are kept in a pool instead of freed. When the writer
+ * has wrapped around a mostly empty block @p shrinkAfterIdleWraps_ times in a row, it moves on
+ * to a smaller pooled block, and back to a bigger pooled block when traffic picks up again.
+ * This way bursty traffic runs without heap allocations once the pool has warmed up.
+ */
+struct BlockPoolSettings
+{
+    size_t maxPooledBlocks_ = 0;      ///< Number of blocks kept for reuse, others are freed
+    size_t shrinkAfterIdleWraps_ = 0; ///< Number of idle wraps before shrinking, 0 to never shrink
+};
+
 /**
  * Dynamically growing queue able to contain heterogeneous elements derived
  * from defined interface @p T.
  *
  * The objects are actually copied to the buffer itself so they need to be
- * copyable or movable.
+ * copyable or movable, unless constructed directly in the buffer with emplace.
  *
- * Thread-safe for one reader and one writer.
+ * Thread-safe for one reader and one writer. For many writers see
+ * MultiProducerHeterogeneousQueue.
  *
- * Note that there's overhead for each element in the buffer.
+ * Note that there's overhead for each element in the buffer: a header of two words, plus padding
+ * to the alignment of the element.
  */
 template <typename T>
 class HeterogeneousQueue
@@ -27,12 +52,23 @@ public:
     /**
      * Construct a queue with initial buffer size of @initialSizeInBytes.
      *
-     * A new buffer doubling the previous size is allocated whenever
-     * the buffer runs out.
+     * A new buffer doubling the previous size, up to MAX_BLOCK_SIZE, is allocated whenever
+     * the buffer runs out, unless one can be reused according to @p blockPoolSettings.
+     *
+     * Throws std::length_error if @p initialSizeInBytes is over MAX_BLOCK_SIZE.
      */
-    HeterogeneousQueue(size_t initialSizeInBytes);
+    HeterogeneousQueue(size_t initialSizeInBytes, BlockPoolSettings blockPoolSettings = BlockPoolSettings{});
     ~HeterogeneousQueue();
 
+    /** Block statistics, can be read from any thread */
+    ///@{
+    size_t getAllocatedBlockCount() const;
+    size_t getReusedBlockCount() const;
+    ///@}
+
+    /** Record waits for elements under @p name, see Common::LockStatisticsRegistry */
+    void setName(const std::string& name);
+
     /**
      * Push new element of type @p U to the buffer.
      * Will allocate more space if there's not enough to push immediately.
@@ -40,17 +76,76 @@ public:
     template <typename U>
     void enqueue(U&& element);
 
+    /**
+     * Construct new element of type @p U in place in the buffer from @p args.
+     * Will allocate more space if there's not enough to push immediately.
+     * If the construction throws, no space is lost for later elements.
+     *
+     * Throws std::length_error if the element can't fit in a block of MAX_BLOCK_SIZE.
+     */
+    template <typename U, typename... Args>
+    void emplace(Args&&... args);
+
     /** @return True if there are no elements in the buffer */
     bool isEmpty() const;
 
+    /** Blocks don't grow bigger than the envelope header can describe */
+    static constexpr size_t MAX_BLOCK_SIZE = std::numeric_limits<uint32_t>::max();
+
     /**
      * Read oldest element from the buffer
      * Will block if there's no elements in the buffer.
      *
-     * @return Reference to oldest element. The reference is valid until next call to dequeue.
+     * @return Reference to oldest element. The reference is valid until next call to any of the dequeue methods.
      */
     const T& dequeue();
 
+    /**
+     * Read oldest element from the buffer if there is one.
+     *
+     * @return Pointer to oldest element or nullptr if the buffer is empty. The pointer is valid until next
+     *         call to any of the dequeue methods.
+     */
+    const T* tryDequeue();
+
+    /**
+     * Read oldest element from the buffer, waiting for a @p duration if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Rep, class Period>
+    const T* dequeueFor(const std::chrono::duration<Rep, Period>& duration);
+
+    /**
+     * Read oldest element from the buffer, waiting until a @p timePoint if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Clock, class Duration>
+    const T* dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+
+    /**
+     * Read all elements currently in the buffer without blocking.
+     *
+     * Each element is passed to @p visitor as a const reference, which is valid only during the call.
+     * The space of the visited elements is released with one notification per block, instead of one per element.
+     * If @p visitor throws, the element it threw on is released and the elements after it are left in the buffer.
+     *
+     * @return Number of visited elements
+     */
+    template <typename Visitor>
+    size_t consumeAll(Visitor visitor);
+
+    /**
+     * Read up to @p maxCount oldest elements from the buffer.
+     * Will block if there's no elements in the buffer, unless @p maxCount is zero.
+     *
+     * @see consumeAll
+     * @return Number of visited elements
+     */
+    template <typename Visitor>
+    size_t dequeueBatch(size_t maxCount, Visitor visitor);
+
 private:
     using byte = unsigned char;
 
@@ -64,11 +159,17 @@ private:
             writePosition_{buffer_.get()},
             freeSpace_(sizeInBytes_)
         {
-            // std::cout << "New block, size: " << sizeInBytes_ << std::endl;
         }
 
         ~Block() = default;
 
+        /** Prepare a block the reader is done with for writing again */
+        void reset()
+        {
+            assert(freeSpace_.getCount() == sizeInBytes_);
+            writePosition_ = begin_;
+        }
+
         size_t sizeInBytes_;
         std::unique_ptr<byte[]> buffer_;
         byte* begin_;
@@ -83,84 +184,188 @@ private:
     std::unique_ptr<Block> writeBlock_; // TODO: consider std::forward_list and a iterator to it
     std::vector<std::unique_ptr<Block>> decayingBlocks_;
 
+    /** Block recycling, accessed by the writer only */
+    ///@{
+    BlockPoolSettings blockPoolSettings_;
+    std::vector<std::unique_ptr<Block>> pooledBlocks_;
+    size_t idleWraps_;
+    std::atomic<size_t> allocatedBlockCount_;
+    std::atomic<size_t> reusedBlockCount_;
+
+    std::unique_ptr<Block> allocateBlock(size_t sizeInBytes);
+    std::unique_ptr<Block> acquireBiggerBlock(size_t sizeInBytes);
+    std::unique_ptr<Block> acquireSmallerBlock(size_t minimumSizeInBytes);
+    std::unique_ptr<Block> takePooledBlock(typename std::vector<std::unique_ptr<Block>>::iterator block);
+    void switchToBlock(std::unique_ptr<Block> block);
+    void recycleDecayingBlocks();
+    bool isIdleLongEnough(size_t freeSpaceInBlock);
+    ///@}
+
     Common::Semaphore queuedMessages_;
     void notifyNewElement();
     void waitForElement();
 
+    struct Envelope;
+
+    /** Type-erased access to an element of concrete type */
+    struct ElementOps
+    {
+        const T* (*get_)(const Envelope& envelope);
+        void (*destroy_)(const Envelope& envelope); ///< nullptr if trivially destructible
+    };
+
+    /**
+     * Header of an element in the buffer. The element follows the header, aligned to its own alignment.
+     *
+     * Padding continues from the beginning of the block, and a link from the beginning of the next block.
+     */
     struct Envelope
     {
-        Envelope(byte* next, const T* element, size_t size, Block* block);
-        virtual ~Envelope() = default;
-        bool isNull() const;
+        enum class Kind : uint32_t
+        {
+            Element,
+            Padding,
+            Link
+        };
 
-        const Envelope* next_;
-        const T* element_;
-        size_t size_;
-        Block* block_;
+        Envelope(size_t size, Kind kind, const ElementOps* ops);
+
+        uint32_t size_;         ///< Bytes taken by the envelope in the block
+        Kind kind_;
+        const ElementOps* ops_; ///< nullptr for padding and links
     };
 
-    template <typename U>
-    struct ElementEnvelope : public Envelope
+    struct LinkEnvelope : public Envelope
     {
-        ElementEnvelope(byte* next, U&& element, size_t size, Block* block);
-        ~ElementEnvelope() override = default;
+        LinkEnvelope(Block* nextBlock);
+
+        Block* nextBlock_;
+    };
 
-        std::remove_reference_t<U> concreteElement_;
+    /** Space taken by a released envelope */
+    struct ReleasedSpace
+    {
+        Block* block_;
+        size_t size_;
     };
 
+    Block* readBlock_;
     const Envelope* currentEnvelope_;
     bool hasCurrentEnvelope_;
 
-    template <typename U>
-    void insertElement(U&& element, size_t envelopeSize);
+    /** Construct an element in @p envelopeSize bytes already waited for in the write block */
+    template <typename U, typename... Args>
+    void insertElement(size_t envelopeSize, Args&&... args);
 
     void insertPadding(size_t paddingSize);
 
     size_t getPotentialFreeSpaceAtBack(Block& block) const;
 
     template <typename U>
-    size_t calculateEnvelopeSize(const U& element)
-    {
-        static const auto maxAlignment = alignof(std::max_align_t);
-        const size_t unalignedSize = sizeof(ElementEnvelope<U>);
+    static const ElementOps* getElementOps();
+    template <typename U>
+    static const T* getElement(const Envelope& envelope);
+    template <typename U>
+    static void destroyElement(const Envelope& envelope);
+    template <typename U>
+    static byte* getElementPosition(const Envelope& envelope);
+    template <typename U>
+    static size_t calculateEnvelopeSize();
+    static size_t alignEnvelopeSize(size_t unalignedSize);
 
-        const size_t remainder = unalignedSize % maxAlignment;
-        if (remainder == 0)
-            return unalignedSize;
+    bool hasCurrentEnvelope() const { return hasCurrentEnvelope_; }
 
-        return unalignedSize + maxAlignment - remainder;
+    /** Release the element returned by previous dequeue, if any */
+    void releaseHeldEnvelope()
+    {
+        if (hasCurrentEnvelope_)
+        {
+            releaseCurrentEnvelope();
+            hasCurrentEnvelope_ = false;
+        }
     }
 
-    bool hasCurrentEnvelope() const { return hasCurrentEnvelope_; }
+    /** Skip any padding and hold the current element until next dequeue */
+    const T& holdCurrentEnvelope()
+    {
+        while (isCurrentEnvelopePadding())
+        {
+            releaseCurrentEnvelope();
+        }
 
-    bool isCurrentEnvelopePadding() const { return currentEnvelope_->element_ == nullptr; }
+        hasCurrentEnvelope_ = true;
+        return currentEnvelopedElement();
+    }
+
+    bool isCurrentEnvelopePadding() const { return currentEnvelope_->kind_ != Envelope::Kind::Element; }
 
     void releaseCurrentEnvelope()
     {
-        const Envelope* toBeReleasedEnvelope = currentEnvelope_;
-        currentEnvelope_ = currentEnvelope_->next_;
-
-        const size_t size = toBeReleasedEnvelope->size_;
-        Block* block = toBeReleasedEnvelope->block_;
-        toBeReleasedEnvelope->~Envelope();
-        block->releaseSpace(size);
+        const ReleasedSpace released = discardCurrentEnvelope();
+        released.block_->releaseSpace(released.size_);
     }
 
-    const T& currentEnvelopedElement() const { return *(currentEnvelope_->element_); }
+    /** Destroy the current element, if any, and move to the next envelope without releasing the space */
+    ReleasedSpace discardCurrentEnvelope();
+
+    const T& currentEnvelopedElement() const { return *currentEnvelope_->ops_->get_(*currentEnvelope_); }
+
+    /**
+     * Consumption of a batch of elements taken from queuedMessages_.
+     *
+     * Accumulates the released space per block. When destroyed, also by an exception from a visitor,
+     * releases the pending space and returns the elements not consumed to queuedMessages_.
+     */
+    class BatchConsumer
+    {
+    public:
+        BatchConsumer(HeterogeneousQueue& queue, size_t count);
+        ~BatchConsumer();
+
+        /** Skip any padding and return the current element */
+        const T& nextElement();
+
+        /** Consume the element returned by nextElement */
+        void consumeElement();
+
+    private:
+        HeterogeneousQueue& queue_;
+        size_t unconsumed_;
+        Block* pendingBlock_;
+        size_t pendingBytes_;
+
+        void consumeCurrentEnvelope();
+    };
+
+    /**
+     * Pass @p count elements to @p visitor and release them, accumulating released space per block.
+     * An element the visitor throws on is released, and the elements after it are left in the queue.
+     */
+    template <typename Visitor>
+    size_t visitElements(size_t count, Visitor& visitor);
 };
 
 template <typename T>
-HeterogeneousQueue<T>::HeterogeneousQueue(size_t initialSizeInBytes)
-  : writeBlock_{std::make_unique<Block>(initialSizeInBytes)},
+HeterogeneousQueue<T>::HeterogeneousQueue(size_t initialSizeInBytes, BlockPoolSettings blockPoolSettings)
+  : writeBlock_{},
     decayingBlocks_{},
+    blockPoolSettings_{blockPoolSettings},
+    pooledBlocks_{},
+    idleWraps_{0},
+    allocatedBlockCount_{0},
+    reusedBlockCount_{0},
     queuedMessages_{0},
-    currentEnvelope_{reinterpret_cast<Envelope*>(writeBlock_->buffer_.get())},
+    readBlock_{nullptr},
+    currentEnvelope_{nullptr},
     hasCurrentEnvelope_(false)
 {
-    // std::cout << "Initial writeBlock_: " << (long long)writeBlock_.get() << std::endl;
-    // std::cout << "Initial writeBlock_->begin_: " << (long long)writeBlock_->begin_ << std::endl;
-    // std::cout << "Initial writeBlock_->end_: " << (long long)writeBlock_->end_ << std::endl;
-    // std::cout << "Initial currentEnvelope_: " << (long long)currentEnvelope_ << std::endl;
+    if (initialSizeInBytes > MAX_BLOCK_SIZE)
+        throw std::length_error("HeterogeneousQueue: initial size too big");
+
+    writeBlock_ = allocateBlock(initialSizeInBytes);
+    readBlock_ = writeBlock_.get();
+    currentEnvelope_ = reinterpret_cast<Envelope*>(writeBlock_->begin_);
+    pooledBlocks_.reserve(blockPoolSettings_.maxPooledBlocks_);
 }
 
 template <typename T>
@@ -172,66 +377,84 @@ HeterogeneousQueue<T>::~HeterogeneousQueue()
     }
 
     // Release the last one, if any
-    if (hasCurrentEnvelope_)
-    {
-        // std::cout << "Releasing last" << std::endl;
-        releaseCurrentEnvelope();
-    }
+    releaseHeldEnvelope();
+}
+
+template <typename T>
+size_t HeterogeneousQueue<T>::getAllocatedBlockCount() const
+{
+    return allocatedBlockCount_.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+size_t HeterogeneousQueue<T>::getReusedBlockCount() const
+{
+    return reusedBlockCount_.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+void HeterogeneousQueue<T>::setName(const std::string& name)
+{
+    queuedMessages_.setName(name);
 }
 
 template <typename T>
 template <typename U>
 void HeterogeneousQueue<T>::enqueue(U&& element)
 {
-    const size_t envelopeSize = calculateEnvelopeSize(element);
-    const size_t minimumSpaceNeeded = envelopeSize + sizeof(Envelope);
+    emplace<std::decay_t<U>>(std::forward<U>(element));
+}
+
+template <typename T>
+template <typename U, typename... Args>
+void HeterogeneousQueue<T>::emplace(Args&&... args)
+{
+    const size_t envelopeSize = calculateEnvelopeSize<U>();
+    const size_t minimumSpaceNeeded = envelopeSize + sizeof(LinkEnvelope); // Room to continue elsewhere after
+    if (minimumSpaceNeeded > MAX_BLOCK_SIZE)
+        throw std::length_error("HeterogeneousQueue: element too big");
 
     const size_t potentialSpaceAtBack = getPotentialFreeSpaceAtBack(*writeBlock_);
-    assert(potentialSpaceAtBack >= sizeof(Envelope));
+    assert(potentialSpaceAtBack >= sizeof(LinkEnvelope));
 
     const size_t freeSpaceInBlock = writeBlock_->freeSpace_.getCount();
 
-    // std::cout << "W: Free space in block: " << freeSpaceInBlock << std::endl;
-
     const bool fitsInBack = potentialSpaceAtBack >= minimumSpaceNeeded && freeSpaceInBlock >= minimumSpaceNeeded;
     const bool fitsInBegin = freeSpaceInBlock >= (potentialSpaceAtBack + minimumSpaceNeeded);
     if (fitsInBack)
     {
-        // std::cout << "W: Inserting to back: " << envelopeSize << std::endl;
-
         writeBlock_->waitForSpace(envelopeSize);
-        insertElement(std::forward<U>(element), envelopeSize);
+        insertElement<U>(envelopeSize, std::forward<Args>(args)...);
     }
     else if (fitsInBegin)
     {
-        // std::cout << "W: Inserting padding: " << potentialSpaceAtBack << std::endl;
-        // std::cout << "W: Inserting to begin: " << envelopeSize << std::endl;
-
-        writeBlock_->waitForSpace(potentialSpaceAtBack + envelopeSize);
-
         // If we are able to fill to the beginning of the block, it means any previous blocks have already
-        // been fully dequed, and we can release their memory.
-        decayingBlocks_.clear();
+        // been fully dequed, and we can reuse or release their memory.
+        recycleDecayingBlocks();
+
+        std::unique_ptr<Block> smallerBlock =
+            isIdleLongEnough(freeSpaceInBlock) ? acquireSmallerBlock(minimumSpaceNeeded) : nullptr;
+        if (smallerBlock)
+        {
+            switchToBlock(std::move(smallerBlock));
+        }
+        else
+        {
+            writeBlock_->waitForSpace(potentialSpaceAtBack);
+            insertPadding(potentialSpaceAtBack); // To fill leftover
+        }
 
-        insertPadding(potentialSpaceAtBack); // To fill leftover
-        insertElement(std::forward<U>(element), envelopeSize);
+        writeBlock_->waitForSpace(envelopeSize);
+        insertElement<U>(envelopeSize, std::forward<Args>(args)...);
     }
     else
     {
-        // std::cout << "W: Inserting to new block: " << envelopeSize << std::endl;
-
-        // Does not fit in block, allocate new block and insert there
-        auto newWriteBlock = std::make_unique<Block>(writeBlock_->sizeInBytes_ * 2);
-
-        writeBlock_->waitForSpace(sizeof(Envelope));
-        (void)new (writeBlock_->writePosition_)
-            Envelope(newWriteBlock->begin_, nullptr, sizeof(Envelope), writeBlock_.get());
-
-        decayingBlocks_.push_back(std::move(writeBlock_));
-        writeBlock_ = std::move(newWriteBlock);
+        // Does not fit in block, continue in a new bigger block, big enough for the element at least
+        const size_t grownSize = std::min(writeBlock_->sizeInBytes_ * 2, MAX_BLOCK_SIZE);
+        switchToBlock(acquireBiggerBlock(std::max(minimumSpaceNeeded, grownSize)));
 
         writeBlock_->waitForSpace(envelopeSize);
-        insertElement(std::forward<U>(element), envelopeSize);
+        insertElement<U>(envelopeSize, std::forward<Args>(args)...);
     }
 
     notifyNewElement();
@@ -246,31 +469,133 @@ bool HeterogeneousQueue<T>::isEmpty() const
 template <typename T>
 const T& HeterogeneousQueue<T>::dequeue()
 {
-    if (hasCurrentEnvelope_)
-    {
-        // std::cout << "R: Releasing old" << std::endl;
-        releaseCurrentEnvelope();
-        waitForElement();
-    }
-    else
+    releaseHeldEnvelope();
+    waitForElement();
+
+    return holdCurrentEnvelope();
+}
+
+template <typename T>
+const T* HeterogeneousQueue<T>::tryDequeue()
+{
+    releaseHeldEnvelope();
+    if (!queuedMessages_.tryWait())
+        return nullptr;
+
+    return &holdCurrentEnvelope();
+}
+
+template <typename T>
+template <class Rep, class Period>
+const T* HeterogeneousQueue<T>::dequeueFor(const std::chrono::duration<Rep, Period>& duration)
+{
+    releaseHeldEnvelope();
+    if (!queuedMessages_.waitFor(duration))
+        return nullptr;
+
+    return &holdCurrentEnvelope();
+}
+
+template <typename T>
+template <class Clock, class Duration>
+const T* HeterogeneousQueue<T>::dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    releaseHeldEnvelope();
+    if (!queuedMessages_.waitUntil(timePoint))
+        return nullptr;
+
+    return &holdCurrentEnvelope();
+}
+
+template <typename T>
+template <typename Visitor>
+size_t HeterogeneousQueue<T>::consumeAll(Visitor visitor)
+{
+    releaseHeldEnvelope();
+    return visitElements(queuedMessages_.tryWaitUpTo(std::numeric_limits<size_t>::max()), visitor);
+}
+
+template <typename T>
+template <typename Visitor>
+size_t HeterogeneousQueue<T>::dequeueBatch(size_t maxCount, Visitor visitor)
+{
+    releaseHeldEnvelope();
+    return visitElements(queuedMessages_.waitUpTo(maxCount), visitor);
+}
+
+template <typename T>
+template <typename Visitor>
+size_t HeterogeneousQueue<T>::visitElements(size_t count, Visitor& visitor)
+{
+    BatchConsumer batch(*this, count);
+
+    for (size_t i = 0; i < count; ++i)
     {
-        waitForElement();
-        hasCurrentEnvelope_ = true;
+        const T& element = batch.nextElement();
+        try
+        {
+            visitor(element);
+        }
+        catch (...)
+        {
+            // Not visited again, like an element returned by dequeue
+            batch.consumeElement();
+            throw;
+        }
+        batch.consumeElement();
     }
 
-    while (isCurrentEnvelopePadding())
+    return count;
+}
+
+template <typename T>
+HeterogeneousQueue<T>::BatchConsumer::BatchConsumer(HeterogeneousQueue& queue, size_t count)
+  : queue_(queue), unconsumed_(count), pendingBlock_(nullptr), pendingBytes_(0)
+{
+}
+
+template <typename T>
+HeterogeneousQueue<T>::BatchConsumer::~BatchConsumer()
+{
+    if (pendingBlock_)
+        pendingBlock_->releaseSpace(pendingBytes_);
+
+    if (unconsumed_ > 0)
+        queue_.queuedMessages_.notify(unconsumed_);
+}
+
+template <typename T>
+const T& HeterogeneousQueue<T>::BatchConsumer::nextElement()
+{
+    while (queue_.isCurrentEnvelopePadding())
     {
-        // std::cout << "R: Releasing padding" << std::endl;
-        // std::cout << "R: Read padding from: " << (long long)currentEnvelope_ << " in block: " << (long
-        // long)currentEnvelope_->block_ << std::endl;
-        releaseCurrentEnvelope();
+        consumeCurrentEnvelope();
     }
 
-    // std::cout << "R: Read element from: " << (long long)currentEnvelope_ << " in block: " << (long
-    // long)currentEnvelope_->block_ << std::endl;  std::cout << "R: Free space in block: " <<
-    // (int)currentEnvelope_->block_->freeSpace_.getCount() << std::endl;
+    return queue_.currentEnvelopedElement();
+}
 
-    return currentEnvelopedElement();
+template <typename T>
+void HeterogeneousQueue<T>::BatchConsumer::consumeElement()
+{
+    consumeCurrentEnvelope();
+    --unconsumed_;
+}
+
+template <typename T>
+void HeterogeneousQueue<T>::BatchConsumer::consumeCurrentEnvelope()
+{
+    const ReleasedSpace consumed = queue_.discardCurrentEnvelope();
+
+    if (consumed.block_ != pendingBlock_)
+    {
+        if (pendingBlock_)
+            pendingBlock_->releaseSpace(pendingBytes_);
+
+        pendingBlock_ = consumed.block_;
+        pendingBytes_ = 0;
+    }
+    pendingBytes_ += consumed.size_;
 }
 
 template <typename T>
@@ -285,48 +610,214 @@ void HeterogeneousQueue<T>::waitForElement()
 }
 
 template <typename T>
-HeterogeneousQueue<T>::Envelope::Envelope(byte* next, const T* element, size_t size, Block* block)
-  : next_(reinterpret_cast<Envelope*>(next)), element_(element), size_(size), block_(block)
+typename HeterogeneousQueue<T>::ReleasedSpace HeterogeneousQueue<T>::discardCurrentEnvelope()
+{
+    const Envelope& envelope = *currentEnvelope_;
+    const ReleasedSpace released{readBlock_, envelope.size_};
+
+    switch (envelope.kind_)
+    {
+        case Envelope::Kind::Element:
+            currentEnvelope_ =
+                reinterpret_cast<const Envelope*>(reinterpret_cast<const byte*>(&envelope) + envelope.size_);
+            if (envelope.ops_->destroy_)
+                envelope.ops_->destroy_(envelope);
+            break;
+        case Envelope::Kind::Padding:
+            currentEnvelope_ = reinterpret_cast<const Envelope*>(readBlock_->begin_);
+            break;
+        case Envelope::Kind::Link:
+            readBlock_ = static_cast<const LinkEnvelope&>(envelope).nextBlock_;
+            currentEnvelope_ = reinterpret_cast<const Envelope*>(readBlock_->begin_);
+            break;
+    }
+
+    return released;
+}
+
+template <typename T>
+HeterogeneousQueue<T>::Envelope::Envelope(size_t size, Kind kind, const ElementOps* ops)
+  : size_(static_cast<uint32_t>(size)), kind_(kind), ops_(ops)
+{
+    assert(size <= std::numeric_limits<uint32_t>::max());
+}
+
+template <typename T>
+HeterogeneousQueue<T>::LinkEnvelope::LinkEnvelope(Block* nextBlock)
+  : Envelope(sizeof(LinkEnvelope), Envelope::Kind::Link, nullptr), nextBlock_(nextBlock)
+{
+}
+
+template <typename T>
+template <typename U, typename... Args>
+void HeterogeneousQueue<T>::insertElement(size_t envelopeSize, Args&&... args)
+{
+    byte* position = writeBlock_->writePosition_;
+    byte* next = position + envelopeSize;
+
+    const Envelope* envelope = new (position) Envelope(envelopeSize, Envelope::Kind::Element, getElementOps<U>());
+    try
+    {
+        (void)new (getElementPosition<U>(*envelope)) U(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        // Nothing written yet, so give the reserved space back to the block
+        writeBlock_->releaseSpace(envelopeSize);
+        throw;
+    }
+    writeBlock_->writePosition_ = next;
+}
+
+template <typename T>
+void HeterogeneousQueue<T>::insertPadding(size_t paddingSize)
 {
+    (void)new (writeBlock_->writePosition_) Envelope(paddingSize, Envelope::Kind::Padding, nullptr);
+    writeBlock_->writePosition_ = writeBlock_->begin_;
 }
 
 template <typename T>
-bool HeterogeneousQueue<T>::Envelope::isNull() const
+template <typename U>
+const typename HeterogeneousQueue<T>::ElementOps* HeterogeneousQueue<T>::getElementOps()
 {
-    return element_ == nullptr;
+    static constexpr ElementOps ops{
+        &getElement<U>, std::is_trivially_destructible<U>::value ? nullptr : &destroyElement<U>};
+    return &ops;
 }
 
 template <typename T>
 template <typename U>
-HeterogeneousQueue<T>::ElementEnvelope<U>::ElementEnvelope(byte* next, U&& element, size_t size, Block* block)
-  : Envelope(next, &concreteElement_, size, block), concreteElement_(std::forward<U>(element))
+const T* HeterogeneousQueue<T>::getElement(const Envelope& envelope)
 {
-    // std::cout << "W: Element address: " << (long long)&concreteElement_ << " in block: " << (long long)block <<
-    // std::endl;
+    return std::launder(reinterpret_cast<const U*>(getElementPosition<U>(envelope)));
 }
 
 template <typename T>
 template <typename U>
-void HeterogeneousQueue<T>::insertElement(U&& element, size_t envelopeSize)
+void HeterogeneousQueue<T>::destroyElement(const Envelope& envelope)
 {
-    byte* next = writeBlock_->writePosition_ + envelopeSize;
+    std::launder(reinterpret_cast<const U*>(getElementPosition<U>(envelope)))->~U();
+}
 
-    // std::cout << "W: Inserting element to: " << (long long)writeBlock_->writePosition_ << " in block: " << (long
-    // long)writeBlock_.get() << std::endl;
+template <typename T>
+template <typename U>
+typename HeterogeneousQueue<T>::byte* HeterogeneousQueue<T>::getElementPosition(const Envelope& envelope)
+{
+    const std::uintptr_t unaligned = reinterpret_cast<std::uintptr_t>(&envelope) + sizeof(Envelope);
+    return reinterpret_cast<byte*>((unaligned + alignof(U) - 1) & ~(alignof(U) - 1));
+}
 
-    (void)new (writeBlock_->writePosition_)
-        ElementEnvelope<U>(next, std::forward<U>(element), envelopeSize, writeBlock_.get());
-    writeBlock_->writePosition_ = next;
+template <typename T>
+template <typename U>
+size_t HeterogeneousQueue<T>::calculateEnvelopeSize()
+{
+    // Envelopes are aligned to a word, so alignment beyond that may need padding before the element
+    const size_t alignmentPadding = alignof(U) > alignof(LinkEnvelope) ? alignof(U) - alignof(LinkEnvelope) : 0;
+    return alignEnvelopeSize(sizeof(Envelope) + alignmentPadding + sizeof(U));
 }
 
 template <typename T>
-void HeterogeneousQueue<T>::insertPadding(size_t paddingSize)
+size_t HeterogeneousQueue<T>::alignEnvelopeSize(size_t unalignedSize)
 {
-    // std::cout << "W: Inserting padding to: " << (long long)writeBlock_->writePosition_ << " in block: " << (long
-    // long)writeBlock_.get() << std::endl;
+    static const auto envelopeAlignment = alignof(LinkEnvelope);
 
-    (void)new (writeBlock_->writePosition_) Envelope(writeBlock_->begin_, nullptr, paddingSize, writeBlock_.get());
-    writeBlock_->writePosition_ = writeBlock_->begin_;
+    const size_t remainder = unalignedSize % envelopeAlignment;
+    if (remainder == 0)
+        return unalignedSize;
+
+    return unalignedSize + envelopeAlignment - remainder;
+}
+
+template <typename T>
+std::unique_ptr<typename HeterogeneousQueue<T>::Block> HeterogeneousQueue<T>::allocateBlock(size_t sizeInBytes)
+{
+    allocatedBlockCount_.fetch_add(1, std::memory_order_relaxed);
+    return std::make_unique<Block>(sizeInBytes);
+}
+
+template <typename T>
+std::unique_ptr<typename HeterogeneousQueue<T>::Block> HeterogeneousQueue<T>::acquireBiggerBlock(size_t sizeInBytes)
+{
+    // Smallest pooled block big enough
+    auto best = pooledBlocks_.end();
+    for (auto block = pooledBlocks_.begin(); block != pooledBlocks_.end(); ++block)
+    {
+        if ((*block)->sizeInBytes_ >= sizeInBytes &&
+            (best == pooledBlocks_.end() || (*block)->sizeInBytes_ < (*best)->sizeInBytes_))
+            best = block;
+    }
+
+    if (best == pooledBlocks_.end())
+        return allocateBlock(sizeInBytes);
+
+    return takePooledBlock(best);
+}
+
+template <typename T>
+std::unique_ptr<typename HeterogeneousQueue<T>::Block> HeterogeneousQueue<T>::acquireSmallerBlock(
+    size_t minimumSizeInBytes)
+{
+    // Biggest pooled block smaller than the current one
+    auto best = pooledBlocks_.end();
+    for (auto block = pooledBlocks_.begin(); block != pooledBlocks_.end(); ++block)
+    {
+        if ((*block)->sizeInBytes_ < writeBlock_->sizeInBytes_ && (*block)->sizeInBytes_ >= minimumSizeInBytes &&
+            (best == pooledBlocks_.end() || (*block)->sizeInBytes_ > (*best)->sizeInBytes_))
+            best = block;
+    }
+
+    if (best == pooledBlocks_.end())
+        return nullptr;
+
+    return takePooledBlock(best);
+}
+
+template <typename T>
+std::unique_ptr<typename HeterogeneousQueue<T>::Block> HeterogeneousQueue<T>::takePooledBlock(
+    typename std::vector<std::unique_ptr<Block>>::iterator block)
+{
+    std::unique_ptr<Block> taken = std::move(*block);
+    pooledBlocks_.erase(block);
+
+    taken->reset();
+    reusedBlockCount_.fetch_add(1, std::memory_order_relaxed);
+    return taken;
+}
+
+template <typename T>
+void HeterogeneousQueue<T>::switchToBlock(std::unique_ptr<Block> block)
+{
+    writeBlock_->waitForSpace(sizeof(LinkEnvelope));
+    (void)new (writeBlock_->writePosition_) LinkEnvelope(block.get());
+
+    decayingBlocks_.push_back(std::move(writeBlock_));
+    writeBlock_ = std::move(block);
+    idleWraps_ = 0;
+}
+
+template <typename T>
+void HeterogeneousQueue<T>::recycleDecayingBlocks()
+{
+    for (auto& block : decayingBlocks_)
+    {
+        if (pooledBlocks_.size() < blockPoolSettings_.maxPooledBlocks_)
+            pooledBlocks_.push_back(std::move(block));
+    }
+    decayingBlocks_.clear();
+}
+
+template <typename T>
+bool HeterogeneousQueue<T>::isIdleLongEnough(size_t freeSpaceInBlock)
+{
+    if (blockPoolSettings_.shrinkAfterIdleWraps_ == 0)
+        return false;
+
+    // Idle when at most a quarter of the block is in use
+    const size_t sizeInBytes = writeBlock_->sizeInBytes_;
+    const bool isIdle = sizeInBytes - freeSpaceInBlock <= sizeInBytes / 4;
+
+    idleWraps_ = isIdle ? idleWraps_ + 1 : 0;
+    return idleWraps_ >= blockPoolSettings_.shrinkAfterIdleWraps_;
 }
 
 template <typename T>
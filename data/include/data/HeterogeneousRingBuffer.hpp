@@ -1,35 +1,218 @@
 #pragma once
 
+#include "common/CacheLine.hpp"
+#include "common/Parking.hpp"
 #include "common/Semaphore.hpp"
 #include <assert.h>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <type_traits>
+#include <utility>
 
 namespace Data {
 
+/** HeterogeneousRingBuffer synchronization policies. */
+///@{
+
+/**
+ * Space and element accounting with Common::Semaphore. Every operation updates a counter shared by both threads.
+ *
+ * Space is waited for and returned (when reserved but not used) by the writer,
+ * and released by the reader.
+ */
+class SemaphoreSync
+{
+public:
+    explicit SemaphoreSync(size_t capacity);
+
+    void releaseSpace(size_t bytes);
+    void waitForSpace(size_t bytes);
+    bool tryWaitForSpace(size_t bytes);
+    void returnSpace(size_t bytes);
+    void notifyNewElement();
+    void waitForElement();
+    bool tryWaitForElement();
+    template <class Rep, class Period>
+    bool waitForElementFor(const std::chrono::duration<Rep, Period>& duration);
+    template <class Clock, class Duration>
+    bool waitForElementUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+    bool isEmpty() const;
+
+private:
+    /** Counter for free space in the buffer */
+    alignas(Common::CACHE_LINE_SIZE) Common::Semaphore freeSpace_;
+
+    /** Counter for elements in the queue */
+    alignas(Common::CACHE_LINE_SIZE) Common::Semaphore queuedElements_;
+};
+
+/**
+ * Lock-free space and element accounting for one reader and one writer.
+ *
+ * Free space is tracked with two monotonically increasing byte cursors: the head is
+ * advanced by the writer when reserving space and the tail by the reader when releasing it.
+ * Elements are tracked with published and consumed counters. Writer and reader state are
+ * kept on separate cache lines, and each side caches its last view of the other side's
+ * cursor so the shared line is only read when the cached view runs out.
+ *
+ * A thread blocks only when the buffer is actually full or empty, see Common::Parking.
+ */
+class LockFreeSync
+{
+public:
+    explicit LockFreeSync(size_t capacity);
+
+    void releaseSpace(size_t bytes);
+    void waitForSpace(size_t bytes);
+    bool tryWaitForSpace(size_t bytes);
+    void returnSpace(size_t bytes);
+    void notifyNewElement();
+    void waitForElement();
+    bool tryWaitForElement();
+    template <class Rep, class Period>
+    bool waitForElementFor(const std::chrono::duration<Rep, Period>& duration);
+    template <class Clock, class Duration>
+    bool waitForElementUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+    bool isEmpty() const;
+
+private:
+    /** Check for space or elements, refreshing the cached view of the other side if needed */
+    bool hasSpace(size_t bytes);
+    bool hasElement();
+
+    const size_t capacity_;
+
+    /** Writer owned state */
+    ///@{
+    alignas(Common::CACHE_LINE_SIZE) size_t head_; ///< Bytes reserved by the writer
+    size_t cachedTail_;                            ///< Writer's last view of tail_
+    std::atomic<size_t> publishedElements_;
+    ///@}
+
+    /** Reader owned state */
+    ///@{
+    alignas(Common::CACHE_LINE_SIZE) std::atomic<size_t> tail_; ///< Bytes released by the reader
+    std::atomic<size_t> consumedElements_;
+    size_t cachedPublishedElements_; ///< Reader's last view of publishedElements_
+    ///@}
+
+    /** Where the writer waits for space and the reader waits for elements */
+    alignas(Common::CACHE_LINE_SIZE) Common::Parking writerParking_;
+    alignas(Common::CACHE_LINE_SIZE) Common::Parking readerParking_;
+};
+
+///@}
+
+/** HeterogeneousRingBuffer layouts, defining the alignment of its state sections. */
+///@{
+
+/** Writer owned, reader owned and shared state on separate cache lines */
+struct CacheLineLayout
+{
+    static constexpr size_t SECTION_ALIGNMENT = Common::CACHE_LINE_SIZE;
+};
+
+/**
+ * Sections packed next to each other, sharing cache lines between the threads.
+ * Only for measuring the effect of the cache line layout. The sync policies keep their own layout.
+ */
+struct PackedLayout
+{
+    static constexpr size_t SECTION_ALIGNMENT = alignof(std::max_align_t);
+};
+
+///@}
+
 /**
  * Fixed @p BYTES size ring buffer able to contain heterogeneous elements
  * derived from defined interface @p T.
  *
  * The objects are actually copied to the buffer itself so they need to be
- * copyable.
+ * copyable or movable, unless constructed directly in the buffer with emplace.
+ * Elements are destroyed when released, or with the buffer if never read.
+ *
+ * Raw bytes can also be written directly to the buffer with reserve and commit,
+ * and read with peek and release, without wrapping them in an element.
  *
  * Thread-safe for one reader and one writer.
  *
  * Note that there's overhead for each element in the buffer.
+ *
+ * With the default layout writer owned, reader owned and shared state are kept on separate
+ * cache lines, so the two threads only share the lines they actually exchange data through.
+ *
+ * @tparam T Element interface type
+ * @tparam BYTES Buffer size
+ * @tparam Sync Synchronization policy, SemaphoreSync or LockFreeSync
+ * @tparam Layout State layout, CacheLineLayout or PackedLayout
  */
-template <typename T, size_t BYTES>
+template <typename T, size_t BYTES, typename Sync = SemaphoreSync, typename Layout = CacheLineLayout>
 class HeterogeneousRingBuffer
 {
 public:
+    using byte = unsigned char;
+
+    /** Bytes in the buffer */
+    ///@{
+    struct WritableBytes
+    {
+        byte* data_;
+        size_t size_;
+    };
+    struct ReadableBytes
+    {
+        const byte* data_;
+        size_t size_;
+    };
+    ///@}
+
     /** Construct a HeterogeneousRingBuffer */
     HeterogeneousRingBuffer();
 
+    /** Destroy the elements left in the buffer. To be called when neither reader nor writer is using it. */
+    ~HeterogeneousRingBuffer();
+
+    /** Prevent copy, move and assignment */
+    HeterogeneousRingBuffer(const HeterogeneousRingBuffer&) = delete;
+    HeterogeneousRingBuffer& operator=(const HeterogeneousRingBuffer&) = delete;
+
     /**
      * Push new element of type @p U to the buffer.
      * Will block waiting for space if there's not enough to push immediately.
      */
     template <typename U>
-    void enqueue(const U& element);
+    void enqueue(U&& element);
+
+    /**
+     * Push new element of type @p U to the buffer if there's enough space to push immediately.
+     *
+     * @return True if the element was pushed, false if the buffer is full
+     */
+    template <typename U>
+    bool tryEnqueue(U&& element);
+
+    /**
+     * Construct new element of type @p U in place in the buffer from @p args.
+     * Will block waiting for space if there's not enough to push immediately.
+     * If the construction throws, the buffer is left as it was.
+     */
+    template <typename U, typename... Args>
+    void emplace(Args&&... args);
+
+    /**
+     * Reserve @p bytes of contiguous space in the buffer to write to.
+     * Will block waiting for space if there's not enough to reserve immediately.
+     *
+     * @return Reserved space. Valid until commit, which must be called before any other writing.
+     */
+    WritableBytes reserve(size_t bytes);
+
+    /**
+     * Push the first @p bytes of the reserved space to the buffer as a single entry to be read with peek.
+     * Any remaining reserved space is returned to the buffer.
+     */
+    void commit(size_t bytes);
 
     /** @return True if there are no elements in the buffer */
     bool isEmpty() const;
@@ -38,43 +221,96 @@ public:
      * Read oldest element from the buffer
      * Will block if there's no elements in the buffer.
      *
-     * @return Reference to oldest element. The reference is valid until next call to dequeue.
+     * @return Reference to oldest element. The reference is valid until next call to any of the dequeue methods.
      */
     const T& dequeue();
 
+    /**
+     * Read oldest element from the buffer if there is one.
+     *
+     * @return Pointer to oldest element or nullptr if the buffer is empty. The pointer is valid until next
+     *         call to any of the dequeue methods.
+     */
+    const T* tryDequeue();
+
+    /**
+     * Read oldest element from the buffer, waiting for a @p duration if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Rep, class Period>
+    const T* dequeueFor(const std::chrono::duration<Rep, Period>& duration);
+
+    /**
+     * Read oldest element from the buffer, waiting until a @p timePoint if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Clock, class Duration>
+    const T* dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+
+    /**
+     * Read oldest entry from the buffer, which must be bytes pushed with commit.
+     * Will block if there's no elements in the buffer.
+     *
+     * @return Committed bytes. Valid until release or next call to any of the dequeue methods.
+     */
+    ReadableBytes peek();
+
+    /** Release the element or bytes read last, giving its space back to the writer. */
+    void release();
+
 private:
-    using byte = unsigned char;
+    static constexpr size_t SECTION_ALIGNMENT = Layout::SECTION_ALIGNMENT;
 
-    /** Actual buffer and pointers to it */
+    /** Pointers to the buffer, not modified after construction */
     ///@{
-    byte buffer_[BYTES];
-    byte* begin_;
-    byte* end_;
-    byte* writePosition_;
+    alignas(SECTION_ALIGNMENT) byte* const begin_;
+    byte* const end_;
     ///@}
 
-    /** Counter for free space in the buffer */
-    Common::Semaphore freeSpace_;
+    /** Free space and element accounting, with its own layout */
+    alignas(SECTION_ALIGNMENT) alignas(Sync) Sync sync_;
     void releaseSpace(size_t bytes);
     void waitForSpace(size_t bytes);
-
-    /** Counter for elements in the queue */
-    Common::Semaphore queuedElements_;
     void notifyNewElement();
     void waitForElement();
 
-    /** Wrapper for a queue element. Keeps up a single-linked list of wrappers in the queue. */
+    /**
+     * Wrapper for a queue element. Keeps up a single-linked list of wrappers in the queue.
+     *
+     * Padding and bytes have no element. Padding always continues from the beginning of the buffer.
+     */
+    struct Envelope;
+
+    /** Type-erased access to an element of concrete type */
+    struct ElementOps
+    {
+        const T* (*get_)(const Envelope& envelope);
+        void (*destroy_)(const Envelope& envelope); ///< nullptr if trivially destructible
+    };
+
     struct Envelope
     {
-        Envelope(byte* next, T* element);
-        const Envelope* next_; ///< Future position of next wrapper
-        T* element_;           ///< Wrapped element
+        Envelope(byte* next, const ElementOps* ops);
+        const Envelope* next_;  ///< Future position of next wrapper
+        const ElementOps* ops_; ///< Wrapped element access, nullptr for padding and bytes
+    };
+    /** Wrapper for committed bytes, which follow the envelope */
+    struct BytesEnvelope : public Envelope
+    {
+        BytesEnvelope(byte* next, size_t size);
+        size_t size_;
     };
     /** Template to allow heterogeneous elements */
     template <typename U>
     struct ElementEnvelope : public Envelope
     {
-        ElementEnvelope(byte* next, const U& element);
+        template <typename... Args>
+        ElementEnvelope(byte* next, Args&&... args);
+        static const ElementOps* getOps();
+        static const T* get(const Envelope& envelope);
+        static void destroy(const Envelope& envelope);
         U concreteElement_;
     };
 
@@ -82,22 +318,25 @@ private:
      * The envelope we are currently reading and the methods
      * to query and modify it.
      *
-     * Initially there's no current envelope. After first read
-     * it is initialized and there after is will always point to
-     * the current element. While the reading blocks waiting for a
-     * new element the envelope is undefined.
+     * The current envelope always points to the position of the next
+     * element to read. It is held, i.e. not yet released, from a successful
+     * dequeue until the next call to any of the dequeue methods.
      *
      * @see dequeue
      */
     ///@{
-    const Envelope* currentEnvelope;
+    alignas(SECTION_ALIGNMENT) const Envelope* currentEnvelope;
+    bool hasCurrentEnvelope_;
 
     bool hasCurrentEnvelope() const;
     bool isCurrentEnvelopePadding() const;
-    void initializeCurrentEnvelope();
+    bool isCurrentEnvelopeBytes() const;
+    void releaseHeldEnvelope();
+    void holdCurrentEnvelope();
     void releaseCurrentEnvelope();
     size_t calculateCurrentEnvelopeSize() const;
     const T& currentEnvelopedElement() const;
+    ReadableBytes currentEnvelopedBytes() const;
     ///@}
 
     /**
@@ -107,145 +346,507 @@ private:
      * @see enqueue
      */
     ///@{
+    alignas(SECTION_ALIGNMENT) byte* writePosition_;
+    size_t reservedSize_; ///< Space reserved for bytes until commit
+
     size_t getPotentialFreeSpaceAtBack() const;
     void insertPadding();
+    template <typename SpaceWaiter>
+    bool acquireEnvelopeSpace(size_t envelopeSize, SpaceWaiter acquireSpace);
+    template <typename U, typename SpaceWaiter, typename... Args>
+    bool emplaceWith(SpaceWaiter acquireSpace, Args&&... args);
+    template <typename U, typename... Args>
+    void insertElement(Args&&... args);
     template <typename U>
-    void insertElement(const U& element);
-    template <typename U>
-    size_t calculateEnvelopeSize(const U& element);
+    size_t calculateEnvelopeSize();
+    size_t alignEnvelopeSize(size_t unalignedSize);
     ///@}
+
+    /** Actual buffer, in a section of its own */
+    alignas(SECTION_ALIGNMENT) byte buffer_[BYTES];
 };
 
-template <typename T, size_t BYTES>
-HeterogeneousRingBuffer<T, BYTES>::HeterogeneousRingBuffer()
-  : buffer_(),
-    begin_(buffer_),
-    end_(buffer_ + BYTES),
-    writePosition_(buffer_),
-    freeSpace_(BYTES),
-    queuedElements_(0),
-    currentEnvelope(nullptr)
+// SemaphoreSync implementation
+inline SemaphoreSync::SemaphoreSync(size_t capacity) : freeSpace_(capacity), queuedElements_(0) {}
+
+inline void SemaphoreSync::releaseSpace(size_t bytes)
 {
+    freeSpace_.notify(bytes);
 }
 
-template <typename T, size_t BYTES>
-template <typename U>
-void HeterogeneousRingBuffer<T, BYTES>::enqueue(const U& element)
+inline void SemaphoreSync::waitForSpace(size_t bytes)
 {
-    const size_t envelopeSize = calculateEnvelopeSize(element);
-    const size_t potentialSpaceAtBack = getPotentialFreeSpaceAtBack();
-    assert(potentialSpaceAtBack >= sizeof(Envelope)); // An null envelope should always fit in the back
+    freeSpace_.wait(bytes);
+}
 
-    const size_t minimumSpaceNeededAtBack = envelopeSize + sizeof(Envelope); // Extra space for potential null envelope
-    const bool canFitInBack = potentialSpaceAtBack >= minimumSpaceNeededAtBack;
-    if (canFitInBack)
+inline bool SemaphoreSync::tryWaitForSpace(size_t bytes)
+{
+    return freeSpace_.tryWait(bytes);
+}
+
+inline void SemaphoreSync::returnSpace(size_t bytes)
+{
+    freeSpace_.notify(bytes);
+}
+
+inline void SemaphoreSync::notifyNewElement()
+{
+    queuedElements_.notify();
+}
+
+inline void SemaphoreSync::waitForElement()
+{
+    queuedElements_.wait();
+}
+
+inline bool SemaphoreSync::tryWaitForElement()
+{
+    return queuedElements_.tryWait();
+}
+
+template <class Rep, class Period>
+bool SemaphoreSync::waitForElementFor(const std::chrono::duration<Rep, Period>& duration)
+{
+    return queuedElements_.waitFor(duration);
+}
+
+template <class Clock, class Duration>
+bool SemaphoreSync::waitForElementUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    return queuedElements_.waitUntil(timePoint);
+}
+
+inline bool SemaphoreSync::isEmpty() const
+{
+    return queuedElements_.getCount() == 0;
+}
+
+// LockFreeSync implementation
+inline LockFreeSync::LockFreeSync(size_t capacity)
+  : capacity_(capacity),
+    head_(0),
+    cachedTail_(0),
+    publishedElements_(0),
+    tail_(0),
+    consumedElements_(0),
+    cachedPublishedElements_(0),
+    writerParking_(),
+    readerParking_()
+{
+}
+
+inline void LockFreeSync::releaseSpace(size_t bytes)
+{
+    tail_.store(tail_.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+    writerParking_.notify();
+}
+
+inline void LockFreeSync::waitForSpace(size_t bytes)
+{
+    if (!hasSpace(bytes))
     {
-        waitForSpace(envelopeSize);
-        insertElement(element);
+        writerParking_.wait([&] { return hasSpace(bytes); });
     }
-    else
-    {
-        // We'll need the leftover space in the back + space for the actual element from the beginning
-        waitForSpace(potentialSpaceAtBack + envelopeSize);
 
-        insertPadding(); // To fill leftover
-        insertElement(element);
+    head_ += bytes;
+}
+
+inline bool LockFreeSync::tryWaitForSpace(size_t bytes)
+{
+    if (!hasSpace(bytes))
+        return false;
+
+    head_ += bytes;
+    return true;
+}
+
+inline void LockFreeSync::returnSpace(size_t bytes)
+{
+    head_ -= bytes;
+}
+
+inline void LockFreeSync::notifyNewElement()
+{
+    publishedElements_.store(publishedElements_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    readerParking_.notify();
+}
+
+inline void LockFreeSync::waitForElement()
+{
+    if (!hasElement())
+    {
+        readerParking_.wait([&] { return hasElement(); });
     }
 
-    notifyNewElement();
+    consumedElements_.store(consumedElements_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
 
-template <typename T, size_t BYTES>
-bool HeterogeneousRingBuffer<T, BYTES>::isEmpty() const
+inline bool LockFreeSync::tryWaitForElement()
 {
-    return queuedElements_.getCount() == 0;
+    if (!hasElement())
+        return false;
+
+    consumedElements_.store(consumedElements_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
 }
 
-template <typename T, size_t BYTES>
-const T& HeterogeneousRingBuffer<T, BYTES>::dequeue()
+template <class Rep, class Period>
+bool LockFreeSync::waitForElementFor(const std::chrono::duration<Rep, Period>& duration)
 {
-    if (hasCurrentEnvelope())
+    return waitForElementUntil(std::chrono::steady_clock::now() + duration);
+}
+
+template <class Clock, class Duration>
+bool LockFreeSync::waitForElementUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    if (!hasElement() && !readerParking_.waitUntil([&] { return hasElement(); }, timePoint))
+        return false;
+
+    consumedElements_.store(consumedElements_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return true;
+}
+
+inline bool LockFreeSync::isEmpty() const
+{
+    return publishedElements_.load(std::memory_order_acquire) == consumedElements_.load(std::memory_order_acquire);
+}
+
+inline bool LockFreeSync::hasSpace(size_t bytes)
+{
+    if (head_ + bytes - cachedTail_ <= capacity_)
+        return true;
+
+    cachedTail_ = tail_.load(std::memory_order_acquire);
+    return head_ + bytes - cachedTail_ <= capacity_;
+}
+
+inline bool LockFreeSync::hasElement()
+{
+    const size_t consumed = consumedElements_.load(std::memory_order_relaxed);
+    if (cachedPublishedElements_ != consumed)
+        return true;
+
+    cachedPublishedElements_ = publishedElements_.load(std::memory_order_acquire);
+    return cachedPublishedElements_ != consumed;
+}
+
+// HeterogeneousRingBuffer implementation
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::HeterogeneousRingBuffer()
+  : begin_(buffer_),
+    end_(buffer_ + BYTES),
+    sync_(BYTES),
+    currentEnvelope(reinterpret_cast<Envelope*>(buffer_)),
+    hasCurrentEnvelope_(false),
+    writePosition_(buffer_),
+    reservedSize_(0),
+    buffer_()
+{
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::~HeterogeneousRingBuffer()
+{
+    releaseHeldEnvelope();
+    while (sync_.tryWaitForElement())
     {
-        releaseCurrentEnvelope();
+        holdCurrentEnvelope();
+        releaseHeldEnvelope();
     }
+}
 
-    waitForElement();
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::enqueue(U&& element)
+{
+    emplace<std::decay_t<U>>(std::forward<U>(element));
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::tryEnqueue(U&& element)
+{
+    return emplaceWith<std::decay_t<U>>(
+        [this](size_t bytes) { return sync_.tryWaitForSpace(bytes); }, std::forward<U>(element));
+}
 
-    if (!hasCurrentEnvelope())
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U, typename... Args>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::emplace(Args&&... args)
+{
+    (void)emplaceWith<U>(
+        [this](size_t bytes) {
+            waitForSpace(bytes);
+            return true;
+        },
+        std::forward<Args>(args)...);
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+typename HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::WritableBytes
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::reserve(size_t bytes)
+{
+    const size_t envelopeSize = alignEnvelopeSize(sizeof(BytesEnvelope) + bytes);
+    assert(envelopeSize + sizeof(Envelope) <= BYTES); // Would never fit
+
+    (void)acquireEnvelopeSpace(envelopeSize, [this](size_t bytes) {
+        waitForSpace(bytes);
+        return true;
+    });
+    reservedSize_ = envelopeSize;
+
+    return WritableBytes{writePosition_ + sizeof(BytesEnvelope), bytes};
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::commit(size_t bytes)
+{
+    const size_t envelopeSize = alignEnvelopeSize(sizeof(BytesEnvelope) + bytes);
+    assert(envelopeSize <= reservedSize_);
+
+    byte* next = writePosition_ + envelopeSize;
+    (void)new (writePosition_) BytesEnvelope(next, bytes);
+    writePosition_ = next;
+
+    sync_.returnSpace(reservedSize_ - envelopeSize);
+    reservedSize_ = 0;
+
+    notifyNewElement();
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U, typename SpaceWaiter, typename... Args>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::emplaceWith(SpaceWaiter acquireSpace, Args&&... args)
+{
+    byte* const startPosition = writePosition_;
+    const size_t envelopeSize = calculateEnvelopeSize<U>();
+    if (!acquireEnvelopeSpace(envelopeSize, acquireSpace))
+        return false;
+
+    try
+    {
+        insertElement<U>(std::forward<Args>(args)...);
+    }
+    catch (...)
     {
-        initializeCurrentEnvelope();
+        // Nothing is published yet, so undo any wrap to the beginning and give the space back
+        const bool wrapped = writePosition_ != startPosition;
+        const size_t paddingSize = wrapped ? static_cast<size_t>(end_ - startPosition) : 0;
+        writePosition_ = startPosition;
+        sync_.returnSpace(paddingSize + envelopeSize);
+        throw;
     }
 
-    while (isCurrentEnvelopePadding())
+    notifyNewElement();
+    return true;
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename SpaceWaiter>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::acquireEnvelopeSpace(size_t envelopeSize,
+                                                                           SpaceWaiter acquireSpace)
+{
+    const size_t potentialSpaceAtBack = getPotentialFreeSpaceAtBack();
+    assert(potentialSpaceAtBack >= sizeof(Envelope)); // An null envelope should always fit in the back
+
+    const size_t minimumSpaceNeededAtBack = envelopeSize + sizeof(Envelope); // Extra space for potential null envelope
+    const bool canFitInBack = potentialSpaceAtBack >= minimumSpaceNeededAtBack;
+    if (canFitInBack)
     {
-        releaseCurrentEnvelope();
+        return acquireSpace(envelopeSize);
     }
 
+    // We'll need the leftover space in the back + space for the actual element from the beginning
+    if (!acquireSpace(potentialSpaceAtBack + envelopeSize))
+        return false;
+
+    insertPadding(); // To fill leftover
+    return true;
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::isEmpty() const
+{
+    return sync_.isEmpty();
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+const T& HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::dequeue()
+{
+    releaseHeldEnvelope();
+    waitForElement();
+    holdCurrentEnvelope();
     return currentEnvelopedElement();
 }
 
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::releaseSpace(size_t bytes)
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+const T* HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::tryDequeue()
 {
-    freeSpace_.notify(bytes);
+    releaseHeldEnvelope();
+    if (!sync_.tryWaitForElement())
+        return nullptr;
+
+    holdCurrentEnvelope();
+    return &currentEnvelopedElement();
 }
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::waitForSpace(size_t bytes)
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <class Rep, class Period>
+const T* HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::dequeueFor(const std::chrono::duration<Rep, Period>& duration)
 {
-    freeSpace_.wait(bytes);
+    releaseHeldEnvelope();
+    if (!sync_.waitForElementFor(duration))
+        return nullptr;
+
+    holdCurrentEnvelope();
+    return &currentEnvelopedElement();
 }
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::notifyNewElement()
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <class Clock, class Duration>
+const T* HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::dequeueUntil(
+    const std::chrono::time_point<Clock, Duration>& timePoint)
 {
-    queuedElements_.notify();
+    releaseHeldEnvelope();
+    if (!sync_.waitForElementUntil(timePoint))
+        return nullptr;
+
+    holdCurrentEnvelope();
+    return &currentEnvelopedElement();
 }
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::waitForElement()
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+typename HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ReadableBytes
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::peek()
 {
-    queuedElements_.wait();
+    releaseHeldEnvelope();
+    waitForElement();
+    holdCurrentEnvelope();
+    return currentEnvelopedBytes();
 }
 
-template <typename T, size_t BYTES>
-HeterogeneousRingBuffer<T, BYTES>::Envelope::Envelope(byte* next, T* element)
-  : next_(reinterpret_cast<Envelope*>(next)), element_(element)
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::release()
 {
+    releaseHeldEnvelope();
 }
 
-template <typename T, size_t BYTES>
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::releaseSpace(size_t bytes)
+{
+    sync_.releaseSpace(bytes);
+}
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::waitForSpace(size_t bytes)
+{
+    sync_.waitForSpace(bytes);
+}
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::notifyNewElement()
+{
+    sync_.notifyNewElement();
+}
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::waitForElement()
+{
+    sync_.waitForElement();
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::Envelope::Envelope(byte* next, const ElementOps* ops)
+  : next_(reinterpret_cast<Envelope*>(next)), ops_(ops)
+{
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::BytesEnvelope::BytesEnvelope(byte* next, size_t size)
+  : Envelope(next, nullptr), size_(size)
+{
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U>
+template <typename... Args>
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ElementEnvelope<U>::ElementEnvelope(byte* next, Args&&... args)
+  : Envelope(next, getOps()), concreteElement_(std::forward<Args>(args)...)
+{
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U>
+const typename HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ElementOps*
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ElementEnvelope<U>::getOps()
+{
+    static constexpr ElementOps ops{&get, std::is_trivially_destructible<U>::value ? nullptr : &destroy};
+    return &ops;
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U>
+const T* HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ElementEnvelope<U>::get(const Envelope& envelope)
+{
+    return &static_cast<const ElementEnvelope&>(envelope).concreteElement_;
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
 template <typename U>
-HeterogeneousRingBuffer<T, BYTES>::ElementEnvelope<U>::ElementEnvelope(byte* next, const U& element)
-  : Envelope(next, &concreteElement_), concreteElement_(element)
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ElementEnvelope<U>::destroy(const Envelope& envelope)
 {
+    static_cast<const ElementEnvelope&>(envelope).~ElementEnvelope();
 }
 
-template <typename T, size_t BYTES>
-bool HeterogeneousRingBuffer<T, BYTES>::hasCurrentEnvelope() const
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::hasCurrentEnvelope() const
 {
-    return currentEnvelope != nullptr;
+    return hasCurrentEnvelope_;
 }
 
-template <typename T, size_t BYTES>
-bool HeterogeneousRingBuffer<T, BYTES>::isCurrentEnvelopePadding() const
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::isCurrentEnvelopePadding() const
 {
-    return currentEnvelope->element_ == nullptr;
+    return currentEnvelope->ops_ == nullptr && reinterpret_cast<const byte*>(currentEnvelope->next_) == begin_;
 }
 
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::initializeCurrentEnvelope()
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+bool HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::isCurrentEnvelopeBytes() const
 {
-    currentEnvelope = reinterpret_cast<Envelope*>(begin_);
+    return currentEnvelope->ops_ == nullptr && !isCurrentEnvelopePadding();
 }
 
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::releaseCurrentEnvelope()
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::releaseHeldEnvelope()
 {
+    if (hasCurrentEnvelope())
+    {
+        releaseCurrentEnvelope();
+        hasCurrentEnvelope_ = false;
+    }
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::holdCurrentEnvelope()
+{
+    while (isCurrentEnvelopePadding())
+    {
+        releaseCurrentEnvelope();
+    }
+
+    hasCurrentEnvelope_ = true;
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::releaseCurrentEnvelope()
+{
+    const Envelope& envelope = *currentEnvelope;
     const size_t size = calculateCurrentEnvelopeSize();
-    currentEnvelope = currentEnvelope->next_;
+    currentEnvelope = envelope.next_;
+    if (envelope.ops_ && envelope.ops_->destroy_)
+        envelope.ops_->destroy_(envelope);
     releaseSpace(size);
 }
 
-template <typename T, size_t BYTES>
-size_t HeterogeneousRingBuffer<T, BYTES>::calculateCurrentEnvelopeSize() const
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+size_t HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::calculateCurrentEnvelopeSize() const
 {
     const byte* self = reinterpret_cast<const byte*>(currentEnvelope);
     const byte* next = reinterpret_cast<const byte*>(currentEnvelope->next_);
@@ -253,40 +854,55 @@ size_t HeterogeneousRingBuffer<T, BYTES>::calculateCurrentEnvelopeSize() const
     return next > self ? next - self : end_ - self;
 }
 
-template <typename T, size_t BYTES>
-const T& HeterogeneousRingBuffer<T, BYTES>::currentEnvelopedElement() const
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+const T& HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::currentEnvelopedElement() const
+{
+    assert(!isCurrentEnvelopeBytes()); // Bytes need to be read with peek
+    return *currentEnvelope->ops_->get_(*currentEnvelope);
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+typename HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::ReadableBytes
+HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::currentEnvelopedBytes() const
 {
-    return *currentEnvelope->element_;
+    assert(isCurrentEnvelopeBytes()); // Elements need to be read with dequeue
+    const BytesEnvelope* envelope = static_cast<const BytesEnvelope*>(currentEnvelope);
+    return ReadableBytes{reinterpret_cast<const byte*>(envelope) + sizeof(BytesEnvelope), envelope->size_};
 }
 
-template <typename T, size_t BYTES>
-size_t HeterogeneousRingBuffer<T, BYTES>::getPotentialFreeSpaceAtBack() const
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+size_t HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::getPotentialFreeSpaceAtBack() const
 {
     return static_cast<size_t>(end_ - writePosition_);
 }
 
-template <typename T, size_t BYTES>
-void HeterogeneousRingBuffer<T, BYTES>::insertPadding()
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::insertPadding()
 {
     (void)new (writePosition_) Envelope(begin_, nullptr);
     writePosition_ = begin_;
 }
 
-template <typename T, size_t BYTES>
-template <typename U>
-void HeterogeneousRingBuffer<T, BYTES>::insertElement(const U& element)
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+template <typename U, typename... Args>
+void HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::insertElement(Args&&... args)
 {
-    byte* next = writePosition_ + calculateEnvelopeSize(element);
-    (void)new (writePosition_) ElementEnvelope<U>(next, element);
+    byte* next = writePosition_ + calculateEnvelopeSize<U>();
+    (void)new (writePosition_) ElementEnvelope<U>(next, std::forward<Args>(args)...);
     writePosition_ = next;
 }
 
-template <typename T, size_t BYTES>
+template <typename T, size_t BYTES, typename Sync, typename Layout>
 template <typename U>
-size_t HeterogeneousRingBuffer<T, BYTES>::calculateEnvelopeSize(const U& element)
+size_t HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::calculateEnvelopeSize()
+{
+    return alignEnvelopeSize(sizeof(ElementEnvelope<U>));
+}
+
+template <typename T, size_t BYTES, typename Sync, typename Layout>
+size_t HeterogeneousRingBuffer<T, BYTES, Sync, Layout>::alignEnvelopeSize(size_t unalignedSize)
 {
     static const auto maxAlignment = alignof(std::max_align_t);
-    const size_t unalignedSize = sizeof(ElementEnvelope<U>);
 
     size_t remainder = unalignedSize % maxAlignment;
     if (remainder == 0)
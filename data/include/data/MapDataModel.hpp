@@ -0,0 +1,426 @@
+#pragma once
+
+#include "ChangeDetector.hpp"
+#include "DataModelIf.hpp"
+#include "Publisher.hpp"
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Data {
+
+/**
+ * Data model of an ordered map, publishing the changed keys in addition to the full value.
+ *
+ * The publisher delivers the full map like DataModel does. The delta publisher delivers
+ * the keys inserted, updated and erased since the previous publication, so subscribers can do
+ * work proportional to the change instead of going through the whole map.
+ *
+ * Changes are accumulated until published, so e.g. a key inserted and then erased before
+ * publishing is not reported at all. Single entries can be changed without copying the map.
+ *
+ * Not thread-safe.
+ *
+ * @tparam Map Ordered map type like std::map
+ */
+template <typename Map>
+class MapDataModel : public DataModelIf<Map>
+{
+public:
+    using Key = typename Map::key_type;
+    using Mapped = typename Map::mapped_type;
+
+    /**
+     * Changes since the previous publication, keys in ascending order.
+     *
+     * The published delta refers to the model's map, so notifying doesn't copy it. The first copy
+     * of the delta takes a snapshot of the map, shared by the published delta and all further
+     * copies, so it can be kept and delivered with AsyncSubscriber with one map copy per
+     * publication however many subscribers there are. With Delivery::Latest the coalesced deltas
+     * are merged by coalesce, sharing the snapshot of the later delta.
+     */
+    class Delta
+    {
+    public:
+        /** Construct without changes, referring to @p value until copied */
+        explicit Delta(const Map& value);
+
+        Delta(const Delta& other);
+        Delta(Delta&& other);
+        Delta& operator=(const Delta& other);
+        Delta& operator=(Delta&& other);
+
+        /** @return Value after the changes */
+        const Map& value() const;
+
+        /** Merge the changes of @p later, published after this one, taking its value */
+        void coalesce(const Delta& later);
+
+        std::vector<Key> inserted_;
+        std::vector<Key> updated_;
+        std::vector<Key> erased_;
+
+    private:
+        /** @return Shared snapshot of the value, taken now and kept if not yet */
+        std::shared_ptr<const Map> snapshot() const;
+
+        mutable std::shared_ptr<const Map> snapshot_; ///< Shared copy of the value, null until first copied
+        const Map* value_;
+    };
+
+    /** Construct with @p data as the initial value */
+    explicit MapDataModel(Map data = Map{});
+
+    ~MapDataModel() override;
+
+    /** Replace the whole map and publish the differences */
+    ///@{
+    void set(const Map& data) override;
+    void set(Map&& data) override;
+    ///@}
+
+    /** @return Current map */
+    const Map& get() const override;
+
+    /** @return Publisher of the full map */
+    Publisher<Map>& publisher() override;
+
+    /** @return Publisher of the changes */
+    Publisher<Delta>& deltaPublisher();
+
+    /** Set @p key to @p value and publish the change, if any */
+    template <typename Value>
+    void insertOrAssign(const Key& key, Value&& value);
+
+    /** Erase @p key and publish the change, if it existed */
+    void erase(const Key& key);
+
+    /** Replace the whole map, but do not publish the differences */
+    ///@{
+    void setInternal(const Map& data);
+    void setInternal(Map&& data);
+    ///@}
+
+    /** Set @p key to @p value, but do not publish the change */
+    template <typename Value>
+    void insertOrAssignInternal(const Key& key, Value&& value);
+
+    /** Erase @p key, but do not publish the change */
+    void eraseInternal(const Key& key);
+
+    /** Publish the changes made since the previous publication, if any */
+    void publishPendingChanges();
+
+private:
+    enum class Change
+    {
+        Inserted,
+        Updated,
+        Erased,
+    };
+
+    using Changes = std::map<Key, Change, typename Map::key_compare>;
+
+    /** Record @p change of @p key, combined with the changes not yet published */
+    void recordChange(const Key& key, Change change);
+
+    /** Combine @p change of @p key with the earlier @p changes */
+    static void combineChange(Changes& changes, const Key& key, Change change);
+
+    /** Combine the changes of @p delta with the earlier @p changes */
+    static void combineChanges(Changes& changes, const Delta& delta);
+
+    /** Set the keys of @p delta from @p changes */
+    static void assignKeys(Delta& delta, const Changes& changes);
+
+    /** Record the differences of @p data to the current value */
+    void recordDifferences(const Map& data);
+
+    /** @return True if the mapped values differ */
+    static bool differs(const Mapped& current, const Mapped& value);
+
+    Map data_;
+    Publisher<Map> publisher_;
+    Publisher<Delta> deltaPublisher_;
+    Changes pendingChanges_;
+};
+
+template <typename Map>
+MapDataModel<Map>::Delta::Delta(const Map& value) : inserted_(), updated_(), erased_(), snapshot_(), value_(&value)
+{
+}
+
+template <typename Map>
+MapDataModel<Map>::Delta::Delta(const Delta& other)
+  : inserted_(other.inserted_),
+    updated_(other.updated_),
+    erased_(other.erased_),
+    snapshot_(other.snapshot()),
+    value_(snapshot_.get())
+{
+}
+
+template <typename Map>
+MapDataModel<Map>::Delta::Delta(Delta&& other)
+  : inserted_(std::move(other.inserted_)),
+    updated_(std::move(other.updated_)),
+    erased_(std::move(other.erased_)),
+    snapshot_(other.snapshot()),
+    value_(snapshot_.get())
+{
+}
+
+template <typename Map>
+typename MapDataModel<Map>::Delta& MapDataModel<Map>::Delta::operator=(const Delta& other)
+{
+    inserted_ = other.inserted_;
+    updated_ = other.updated_;
+    erased_ = other.erased_;
+    snapshot_ = other.snapshot();
+    value_ = snapshot_.get();
+    return *this;
+}
+
+template <typename Map>
+typename MapDataModel<Map>::Delta& MapDataModel<Map>::Delta::operator=(Delta&& other)
+{
+    inserted_ = std::move(other.inserted_);
+    updated_ = std::move(other.updated_);
+    erased_ = std::move(other.erased_);
+    snapshot_ = other.snapshot();
+    value_ = snapshot_.get();
+    return *this;
+}
+
+template <typename Map>
+const Map& MapDataModel<Map>::Delta::value() const
+{
+    return *value_;
+}
+
+template <typename Map>
+void MapDataModel<Map>::Delta::coalesce(const Delta& later)
+{
+    Changes changes(value_->key_comp());
+    combineChanges(changes, *this);
+    combineChanges(changes, later);
+
+    snapshot_ = later.snapshot();
+    value_ = snapshot_.get();
+    assignKeys(*this, changes);
+}
+
+template <typename Map>
+std::shared_ptr<const Map> MapDataModel<Map>::Delta::snapshot() const
+{
+    if (!snapshot_)
+        snapshot_ = std::make_shared<const Map>(*value_);
+    return snapshot_;
+}
+
+template <typename Map>
+MapDataModel<Map>::MapDataModel(Map data)
+  : data_(std::move(data)), publisher_(), deltaPublisher_(), pendingChanges_(data_.key_comp())
+{
+}
+
+template <typename Map>
+MapDataModel<Map>::~MapDataModel()
+{
+}
+
+template <typename Map>
+void MapDataModel<Map>::set(const Map& data)
+{
+    setInternal(data);
+    publishPendingChanges();
+}
+
+template <typename Map>
+void MapDataModel<Map>::set(Map&& data)
+{
+    setInternal(std::move(data));
+    publishPendingChanges();
+}
+
+template <typename Map>
+const Map& MapDataModel<Map>::get() const
+{
+    return data_;
+}
+
+template <typename Map>
+Publisher<Map>& MapDataModel<Map>::publisher()
+{
+    return publisher_;
+}
+
+template <typename Map>
+Publisher<typename MapDataModel<Map>::Delta>& MapDataModel<Map>::deltaPublisher()
+{
+    return deltaPublisher_;
+}
+
+template <typename Map>
+template <typename Value>
+void MapDataModel<Map>::insertOrAssign(const Key& key, Value&& value)
+{
+    insertOrAssignInternal(key, std::forward<Value>(value));
+    publishPendingChanges();
+}
+
+template <typename Map>
+void MapDataModel<Map>::erase(const Key& key)
+{
+    eraseInternal(key);
+    publishPendingChanges();
+}
+
+template <typename Map>
+void MapDataModel<Map>::setInternal(const Map& data)
+{
+    recordDifferences(data);
+    data_ = data;
+}
+
+template <typename Map>
+void MapDataModel<Map>::setInternal(Map&& data)
+{
+    recordDifferences(data);
+    data_ = std::move(data);
+}
+
+template <typename Map>
+template <typename Value>
+void MapDataModel<Map>::insertOrAssignInternal(const Key& key, Value&& value)
+{
+    const auto found = data_.find(key);
+    if (found == data_.end())
+    {
+        data_.emplace(key, std::forward<Value>(value));
+        recordChange(key, Change::Inserted);
+    }
+    else if (differs(found->second, value))
+    {
+        found->second = std::forward<Value>(value);
+        recordChange(key, Change::Updated);
+    }
+}
+
+template <typename Map>
+void MapDataModel<Map>::eraseInternal(const Key& key)
+{
+    if (data_.erase(key) > 0)
+        recordChange(key, Change::Erased);
+}
+
+template <typename Map>
+void MapDataModel<Map>::publishPendingChanges()
+{
+    if (pendingChanges_.empty())
+        return;
+
+    Delta delta{data_};
+    assignKeys(delta, pendingChanges_);
+    pendingChanges_.clear();
+
+    publisher_.notifySubscribers(data_);
+    deltaPublisher_.notifySubscribers(delta);
+}
+
+template <typename Map>
+void MapDataModel<Map>::recordChange(const Key& key, Change change)
+{
+    combineChange(pendingChanges_, key, change);
+}
+
+template <typename Map>
+void MapDataModel<Map>::combineChange(Changes& changes, const Key& key, Change change)
+{
+    const auto inserted = changes.emplace(key, change);
+    if (inserted.second)
+        return;
+
+    auto& pending = inserted.first->second;
+    if (pending == Change::Inserted && change == Change::Erased)
+        changes.erase(inserted.first); // Never published, nothing to report
+    else if (pending == Change::Erased && change == Change::Inserted)
+        pending = Change::Updated;
+    else if (change == Change::Erased)
+        pending = Change::Erased;
+    // Otherwise an insertion or update stays as it was
+}
+
+template <typename Map>
+void MapDataModel<Map>::combineChanges(Changes& changes, const Delta& delta)
+{
+    for (const auto& key : delta.inserted_)
+        combineChange(changes, key, Change::Inserted);
+    for (const auto& key : delta.updated_)
+        combineChange(changes, key, Change::Updated);
+    for (const auto& key : delta.erased_)
+        combineChange(changes, key, Change::Erased);
+}
+
+template <typename Map>
+void MapDataModel<Map>::assignKeys(Delta& delta, const Changes& changes)
+{
+    delta.inserted_.clear();
+    delta.updated_.clear();
+    delta.erased_.clear();
+
+    for (const auto& change : changes)
+    {
+        switch (change.second)
+        {
+            case Change::Inserted:
+                delta.inserted_.push_back(change.first);
+                break;
+            case Change::Updated:
+                delta.updated_.push_back(change.first);
+                break;
+            case Change::Erased:
+                delta.erased_.push_back(change.first);
+                break;
+        }
+    }
+}
+
+template <typename Map>
+void MapDataModel<Map>::recordDifferences(const Map& data)
+{
+    // Both maps are ordered by key, so walk them in step
+    const auto less = data_.key_comp();
+    auto current = data_.begin();
+    auto updated = data.begin();
+
+    while (current != data_.end() || updated != data.end())
+    {
+        if (updated == data.end() || (current != data_.end() && less(current->first, updated->first)))
+        {
+            recordChange(current->first, Change::Erased);
+            ++current;
+        }
+        else if (current == data_.end() || less(updated->first, current->first))
+        {
+            recordChange(updated->first, Change::Inserted);
+            ++updated;
+        }
+        else
+        {
+            if (differs(current->second, updated->second))
+                recordChange(current->first, Change::Updated);
+            ++current;
+            ++updated;
+        }
+    }
+}
+
+template <typename Map>
+bool MapDataModel<Map>::differs(const Mapped& current, const Mapped& value)
+{
+    return DefaultChangeDetector<Mapped>{}.differs(current, value);
+}
+
+} // namespace Data
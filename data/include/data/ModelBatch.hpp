@@ -0,0 +1,159 @@
+#pragma once
+
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Data {
+
+/** Check whether @p Model can keep its published value, see DataModel::keepPublishedValue */
+///@{
+template <typename Model, typename = void>
+struct can_keep_published_value : std::false_type
+{
+};
+template <typename Model>
+struct can_keep_published_value<Model, std::void_t<decltype(&Model::keepPublishedValue)>> : std::true_type
+{
+};
+///@}
+
+/**
+ * Batch of updates to any number of data models, published together.
+ *
+ * The new values are set to the models right away without publishing. Commit then publishes
+ * each changed model once with its latest value, in the order the models were first set, so
+ * the subscribers see all the models updated when they are notified and no intermediate values.
+ * A DataModel set back to its value before the batch is not published at all.
+ * Commits at destruction, if not committed before, unless destroyed by an exception unwinding the
+ * stack. The models already set then keep their new values unpublished, until each model's next
+ * publication, e.g. by set or publishPendingChanges.
+ *
+ * Exceptions from the subscribers propagate from commit, the models not yet published staying
+ * pending for the next commit. At destruction they are reported to std::cerr instead and the
+ * rest of the models are still published.
+ *
+ * Works with models having setInternal and publishPendingChanges, like DataModel. Models having
+ * keepPublishedValue are asked to keep their value before the batch, to detect values set back to it.
+ *
+ * Example:
+ *
+ *   {
+ *       ModelBatch batch;
+ *       for (const auto& record : records)
+ *       {
+ *           batch.set(models[record.id_], record.value_);
+ *       }
+ *   } // Each model is published once
+ */
+class ModelBatch
+{
+public:
+    ModelBatch();
+
+    /** Publish the pending changes, unless unwinding. Reports exceptions from the subscribers. */
+    ~ModelBatch();
+
+    /** Prevent copy and assignment */
+    ModelBatch(const ModelBatch&) = delete;
+    ModelBatch& operator=(const ModelBatch&) = delete;
+
+    /** Set @p data to @p model, publishing it on commit */
+    template <typename Model, typename Value>
+    void set(Model& model, Value&& data);
+
+    /**
+     * Publish the pending changes of all models set in the batch.
+     * If a subscriber throws, the models after the one being published stay pending.
+     */
+    void commit();
+
+private:
+    /** Model with a type-erased publish function */
+    struct PendingModel
+    {
+        void* model_;
+        void (*publish_)(void* model);
+    };
+
+    std::vector<PendingModel> pendingModels_; ///< In the order of the first set
+    std::unordered_set<const void*> isPending_;
+    int uncaughtExceptions_; ///< At construction, more at destruction means unwinding
+};
+
+inline ModelBatch::ModelBatch() : pendingModels_(), isPending_(), uncaughtExceptions_(std::uncaught_exceptions()) {}
+
+inline ModelBatch::~ModelBatch()
+{
+    // A batch failing halfway must not publish a partial update
+    if (std::uncaught_exceptions() > uncaughtExceptions_)
+        return;
+
+    // Each failed attempt has published at least the model whose subscriber threw
+    for (;;)
+    {
+        try
+        {
+            commit();
+            return;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "ModelBatch commit failed: " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cerr << "ModelBatch commit failed" << std::endl;
+        }
+    }
+}
+
+template <typename Model, typename Value>
+void ModelBatch::set(Model& model, Value&& data)
+{
+    if (isPending_.insert(&model).second)
+    {
+        if constexpr (can_keep_published_value<Model>::value)
+            model.keepPublishedValue();
+
+        pendingModels_.push_back(
+            PendingModel{&model, [](void* pending) { static_cast<Model*>(pending)->publishPendingChanges(); }});
+    }
+
+    model.setInternal(std::forward<Value>(data));
+}
+
+inline void ModelBatch::commit()
+{
+    // Models the subscribers set to the batch are published on the next commit
+    const std::vector<PendingModel> models = std::move(pendingModels_);
+    pendingModels_.clear();
+    isPending_.clear();
+
+    for (auto pending = models.begin(); pending != models.end(); ++pending)
+    {
+        try
+        {
+            pending->publish_(pending->model_);
+        }
+        catch (...)
+        {
+            // Keep the rest pending, ahead of the ones the subscribers set meanwhile
+            std::vector<PendingModel> unpublished;
+            for (auto rest = std::next(pending); rest != models.end(); ++rest)
+            {
+                if (isPending_.insert(rest->model_).second)
+                    unpublished.push_back(*rest);
+            }
+            unpublished.insert(unpublished.end(), pendingModels_.begin(), pendingModels_.end());
+            pendingModels_ = std::move(unpublished);
+            throw;
+        }
+    }
+}
+
+} // namespace Data
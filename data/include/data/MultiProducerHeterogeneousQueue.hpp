@@ -0,0 +1,592 @@
+#pragma once
+
+#include "common/CacheLine.hpp"
+#include "common/Parking.hpp"
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Data {
+
+/**
+ * Dynamically growing queue able to contain heterogeneous elements derived
+ * from defined interface @p T.
+ *
+ * The objects are actually copied to the buffer itself so they need to be
+ * copyable or movable, unless constructed directly in the buffer with emplace.
+ *
+ * Thread-safe for many writers and one reader.
+ *
+ * Writers reserve space from the current block with a single atomic fetch-add
+ * on a shared write cursor, construct the element in the reserved space and
+ * publish it by setting a ready flag in its envelope. No lock is taken unless
+ * the block runs out: then the writer whose reservation crossed the end of the
+ * block installs the next one, reusing a fully read block if available or
+ * allocating a new one doubling the largest size so far.
+ *
+ * The reader reads envelopes in reservation order, so an element still being
+ * constructed holds back elements reserved after it. If the construction throws,
+ * the reserved space is published as skipped before the exception is passed on.
+ * If the next block can't be allocated, the exception is passed on and the next writer
+ * needing the block tries again. Block buffers come from a BufferAllocator, which can be
+ * replaced for example to take memory from elsewhere or to test allocation failures.
+ *
+ * Note that there's overhead for each element in the buffer: a header of two words, plus padding
+ * to the alignment of the element.
+ */
+template <typename T>
+class MultiProducerHeterogeneousQueue
+{
+public:
+    /** Block buffer */
+    using Buffer = std::unique_ptr<unsigned char[]>;
+
+    /**
+     * Allocates a zero initialized buffer of given size, or throws if it can't.
+     * Called from the writer thread needing the buffer.
+     */
+    using BufferAllocator = std::function<Buffer(size_t sizeInBytes)>;
+
+    /** Default BufferAllocator, allocating from the heap */
+    static Buffer allocateZeroedBuffer(size_t sizeInBytes);
+
+    /**
+     * Construct a queue with initial buffer size of @initialSizeInBytes.
+     *
+     * A new buffer doubling the largest previous size is allocated with @p allocateBuffer
+     * whenever the buffer runs out and there is no fully read buffer to reuse.
+     */
+    MultiProducerHeterogeneousQueue(size_t initialSizeInBytes, BufferAllocator allocateBuffer = allocateZeroedBuffer);
+    ~MultiProducerHeterogeneousQueue();
+
+    /**
+     * Push new element of type @p U to the buffer.
+     * Will allocate more space if there's not enough to push immediately.
+     */
+    template <typename U>
+    void enqueue(U&& element);
+
+    /**
+     * Construct new element of type @p U in place in the buffer from @p args.
+     * Will allocate more space if there's not enough to push immediately.
+     * If the construction or the allocation throws, the queue is left as it was.
+     *
+     * Throws std::length_error if the element can't fit in an envelope of MAX_ENVELOPE_SIZE,
+     * or if the queue would need more than MAX_BLOCKS blocks.
+     */
+    template <typename U, typename... Args>
+    void emplace(Args&&... args);
+
+    /** Envelopes don't grow bigger than the envelope header can describe */
+    static constexpr size_t MAX_ENVELOPE_SIZE = std::numeric_limits<uint32_t>::max();
+
+    /** @return True if there are no published elements in the buffer. To be called by the reader. */
+    bool isEmpty() const;
+
+    /**
+     * Read oldest element from the buffer
+     * Will block if there's no elements in the buffer.
+     *
+     * @return Reference to oldest element. The reference is valid until next call to any of the dequeue methods.
+     */
+    const T& dequeue();
+
+    /**
+     * Read oldest element from the buffer if there is one.
+     *
+     * @return Pointer to oldest element or nullptr if the buffer is empty. The pointer is valid until next
+     *         call to any of the dequeue methods.
+     */
+    const T* tryDequeue();
+
+    /**
+     * Read oldest element from the buffer, waiting for a @p duration if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Rep, class Period>
+    const T* dequeueFor(const std::chrono::duration<Rep, Period>& duration);
+
+    /**
+     * Read oldest element from the buffer, waiting until a @p timePoint if there's no elements in the buffer.
+     *
+     * @return Pointer to oldest element or nullptr on timeout. @see tryDequeue
+     */
+    template <class Clock, class Duration>
+    const T* dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint);
+
+private:
+    using byte = unsigned char;
+
+    /** Prevent copy, move and assignment */
+    MultiProducerHeterogeneousQueue(const MultiProducerHeterogeneousQueue&) = delete;
+    MultiProducerHeterogeneousQueue& operator=(const MultiProducerHeterogeneousQueue&) = delete;
+
+    /** Write cursor contains the index of the current block in the top bits and reserved bytes in the rest */
+    static constexpr unsigned BLOCK_INDEX_SHIFT = 48;
+    static constexpr uint64_t OFFSET_MASK = (uint64_t{1} << BLOCK_INDEX_SHIFT) - 1;
+
+    /** Blocks only double in size, so a small number is enough */
+    static constexpr size_t MAX_BLOCKS = 48;
+
+    struct Block
+    {
+        Block(size_t index, size_t sizeInBytes, Buffer buffer)
+          : index_{index}, sizeInBytes_{sizeInBytes}, buffer_{std::move(buffer)}
+        {
+        }
+
+        const size_t index_;
+        const size_t sizeInBytes_;
+        Buffer buffer_; ///< Zero initialized, and cleared again before reuse
+    };
+
+    struct Envelope;
+
+    /** Type-erased access to an element of concrete type */
+    struct ElementOps
+    {
+        const T* (*get_)(const Envelope& envelope);
+        void (*destroy_)(const Envelope& envelope); ///< nullptr if trivially destructible
+    };
+
+    /** Header of an element in the buffer. The element follows the header, aligned to its own alignment. */
+    struct Envelope
+    {
+        enum class Kind : uint8_t
+        {
+            Element,
+            Skip,    ///< Reserved for an element whose construction failed
+            BlockEnd
+        };
+
+        Envelope(Kind kind, size_t size, const ElementOps* ops);
+
+        /**
+         * Set by the writer once the envelope is constructed. Not touched by the constructor,
+         * as the reader may already be polling it from the zeroed buffer.
+         */
+        std::atomic<bool> ready_;
+        Kind kind_;
+        uint32_t size_;         ///< Bytes taken by the envelope in the block
+        const ElementOps* ops_; ///< nullptr for skips and block ends
+    };
+
+    /** Last envelope in a block, pointing to the next block */
+    struct BlockEnd : public Envelope
+    {
+        explicit BlockEnd(Block* next);
+
+        Block* next_;
+    };
+
+    /** Space always left at the end of each block for the BlockEnd */
+    static constexpr size_t BLOCK_END_SIZE = sizeof(BlockEnd);
+
+    template <typename U>
+    static const ElementOps* getElementOps();
+    template <typename U>
+    static const T* getElement(const Envelope& envelope);
+    template <typename U>
+    static void destroyElement(const Envelope& envelope);
+    template <typename U>
+    static byte* getElementPosition(const Envelope& envelope);
+    template <typename U>
+    static constexpr size_t calculateEnvelopeSize();
+
+    /** Writer state */
+    ///@{
+    alignas(Common::CACHE_LINE_SIZE) std::atomic<uint64_t> writeCursor_;
+
+    /** All blocks by index. New blocks are only added, under blockMutex_, and released on destruction. */
+    alignas(Common::CACHE_LINE_SIZE) std::array<std::unique_ptr<Block>, MAX_BLOCKS> blocks_;
+    std::mutex blockMutex_;
+    BufferAllocator allocateBuffer_; ///< Needs blockMutex_ after construction
+    size_t blockCount_;
+    std::vector<Block*> freeBlocks_;
+
+    void publish(Envelope* envelope);
+    void installNextBlock(Block& block, size_t offset, size_t envelopeSize);
+    Block* acquireBlock(size_t minimumSize, size_t currentSize);
+    ///@}
+
+    /** Reader state */
+    ///@{
+    alignas(Common::CACHE_LINE_SIZE) Block* readBlock_;
+    size_t readOffset_;
+    bool hasCurrentEnvelope_;
+
+    const Envelope* currentEnvelope() const;
+    bool hasElement();
+    void moveToNextBlock();
+    void skipCurrentEnvelope();
+    void releaseHeldEnvelope();
+    const T& holdCurrentEnvelope();
+    ///@}
+
+    alignas(Common::CACHE_LINE_SIZE) Common::Parking readerParking_;
+};
+
+template <typename T>
+typename MultiProducerHeterogeneousQueue<T>::Buffer MultiProducerHeterogeneousQueue<T>::allocateZeroedBuffer(
+    size_t sizeInBytes)
+{
+    return std::make_unique<unsigned char[]>(sizeInBytes);
+}
+
+template <typename T>
+MultiProducerHeterogeneousQueue<T>::MultiProducerHeterogeneousQueue(
+    size_t initialSizeInBytes,
+    BufferAllocator allocateBuffer)
+  : writeCursor_{0},
+    blocks_{},
+    blockMutex_{},
+    allocateBuffer_{std::move(allocateBuffer)},
+    blockCount_{1},
+    freeBlocks_{},
+    readBlock_{nullptr},
+    readOffset_{0},
+    hasCurrentEnvelope_{false},
+    readerParking_{}
+{
+    assert(initialSizeInBytes > BLOCK_END_SIZE);
+    blocks_[0] = std::make_unique<Block>(0, initialSizeInBytes, allocateBuffer_(initialSizeInBytes));
+    readBlock_ = blocks_[0].get();
+}
+
+template <typename T>
+MultiProducerHeterogeneousQueue<T>::~MultiProducerHeterogeneousQueue()
+{
+    while (tryDequeue() != nullptr)
+    {
+    }
+
+    // Release the last one, if any
+    releaseHeldEnvelope();
+}
+
+template <typename T>
+template <typename U>
+void MultiProducerHeterogeneousQueue<T>::enqueue(U&& element)
+{
+    emplace<std::decay_t<U>>(std::forward<U>(element));
+}
+
+template <typename T>
+template <typename U, typename... Args>
+void MultiProducerHeterogeneousQueue<T>::emplace(Args&&... args)
+{
+    const size_t envelopeSize = calculateEnvelopeSize<U>();
+    if (envelopeSize > MAX_ENVELOPE_SIZE)
+        throw std::length_error("MultiProducerHeterogeneousQueue: element too big");
+
+    while (true)
+    {
+        const uint64_t cursor = writeCursor_.fetch_add(envelopeSize, std::memory_order_acquire);
+        Block& block = *blocks_[cursor >> BLOCK_INDEX_SHIFT];
+        const size_t offset = static_cast<size_t>(cursor & OFFSET_MASK);
+        const size_t limit = block.sizeInBytes_ - BLOCK_END_SIZE;
+
+        if (offset + envelopeSize <= limit)
+        {
+            Envelope* envelope =
+                new (block.buffer_.get() + offset) Envelope(Envelope::Kind::Element, envelopeSize, getElementOps<U>());
+            try
+            {
+                (void)new (getElementPosition<U>(*envelope)) U(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                // The reader waits for every reserved envelope, so the space can't be left unpublished
+                envelope->kind_ = Envelope::Kind::Skip;
+                publish(envelope);
+                throw;
+            }
+            publish(envelope);
+            return;
+        }
+
+        if (offset <= limit)
+        {
+            // First reservation over the limit, responsible for moving everyone to the next block
+            installNextBlock(block, offset, envelopeSize);
+        }
+        else
+        {
+            // Someone else is installing the next block, retry once they are done
+            std::this_thread::yield();
+        }
+    }
+}
+
+template <typename T>
+bool MultiProducerHeterogeneousQueue<T>::isEmpty() const
+{
+    const Block* block = readBlock_;
+    size_t offset = readOffset_ + (hasCurrentEnvelope_ ? currentEnvelope()->size_ : 0);
+
+    while (true)
+    {
+        const Envelope* envelope = reinterpret_cast<const Envelope*>(block->buffer_.get() + offset);
+        if (!envelope->ready_.load(std::memory_order_acquire))
+            return true;
+
+        switch (envelope->kind_)
+        {
+            case Envelope::Kind::Element:
+                return false;
+            case Envelope::Kind::Skip:
+                offset += envelope->size_;
+                break;
+            case Envelope::Kind::BlockEnd:
+                block = static_cast<const BlockEnd*>(envelope)->next_;
+                offset = 0;
+                break;
+        }
+    }
+}
+
+template <typename T>
+const T& MultiProducerHeterogeneousQueue<T>::dequeue()
+{
+    releaseHeldEnvelope();
+    if (!hasElement())
+    {
+        readerParking_.wait([this] { return hasElement(); });
+    }
+
+    return holdCurrentEnvelope();
+}
+
+template <typename T>
+const T* MultiProducerHeterogeneousQueue<T>::tryDequeue()
+{
+    releaseHeldEnvelope();
+    if (!hasElement())
+        return nullptr;
+
+    return &holdCurrentEnvelope();
+}
+
+template <typename T>
+template <class Rep, class Period>
+const T* MultiProducerHeterogeneousQueue<T>::dequeueFor(const std::chrono::duration<Rep, Period>& duration)
+{
+    return dequeueUntil(std::chrono::steady_clock::now() + duration);
+}
+
+template <typename T>
+template <class Clock, class Duration>
+const T* MultiProducerHeterogeneousQueue<T>::dequeueUntil(const std::chrono::time_point<Clock, Duration>& timePoint)
+{
+    releaseHeldEnvelope();
+    if (!hasElement() && !readerParking_.waitUntil([this] { return hasElement(); }, timePoint))
+        return nullptr;
+
+    return &holdCurrentEnvelope();
+}
+
+template <typename T>
+MultiProducerHeterogeneousQueue<T>::Envelope::Envelope(Kind kind, size_t size, const ElementOps* ops)
+  : kind_(kind), size_(static_cast<uint32_t>(size)), ops_(ops)
+{
+    assert(size <= std::numeric_limits<uint32_t>::max());
+}
+
+template <typename T>
+MultiProducerHeterogeneousQueue<T>::BlockEnd::BlockEnd(Block* next)
+  : Envelope(Envelope::Kind::BlockEnd, BLOCK_END_SIZE, nullptr), next_(next)
+{
+}
+
+template <typename T>
+template <typename U>
+const typename MultiProducerHeterogeneousQueue<T>::ElementOps* MultiProducerHeterogeneousQueue<T>::getElementOps()
+{
+    static constexpr ElementOps ops{
+        &getElement<U>, std::is_trivially_destructible<U>::value ? nullptr : &destroyElement<U>};
+    return &ops;
+}
+
+template <typename T>
+template <typename U>
+const T* MultiProducerHeterogeneousQueue<T>::getElement(const Envelope& envelope)
+{
+    return std::launder(reinterpret_cast<const U*>(getElementPosition<U>(envelope)));
+}
+
+template <typename T>
+template <typename U>
+void MultiProducerHeterogeneousQueue<T>::destroyElement(const Envelope& envelope)
+{
+    std::launder(reinterpret_cast<const U*>(getElementPosition<U>(envelope)))->~U();
+}
+
+template <typename T>
+template <typename U>
+typename MultiProducerHeterogeneousQueue<T>::byte* MultiProducerHeterogeneousQueue<T>::getElementPosition(
+    const Envelope& envelope)
+{
+    const std::uintptr_t unaligned = reinterpret_cast<std::uintptr_t>(&envelope) + sizeof(Envelope);
+    return reinterpret_cast<byte*>((unaligned + alignof(U) - 1) & ~(alignof(U) - 1));
+}
+
+template <typename T>
+template <typename U>
+constexpr size_t MultiProducerHeterogeneousQueue<T>::calculateEnvelopeSize()
+{
+    // Envelopes are aligned to a word, so alignment beyond that may need padding before the element
+    constexpr size_t envelopeAlignment = alignof(BlockEnd);
+    constexpr size_t alignmentPadding = alignof(U) > envelopeAlignment ? alignof(U) - envelopeAlignment : 0;
+    constexpr size_t unalignedSize = sizeof(Envelope) + alignmentPadding + sizeof(U);
+
+    return (unalignedSize + envelopeAlignment - 1) / envelopeAlignment * envelopeAlignment;
+}
+
+template <typename T>
+void MultiProducerHeterogeneousQueue<T>::publish(Envelope* envelope)
+{
+    envelope->ready_.store(true, std::memory_order_release);
+    readerParking_.notify();
+}
+
+template <typename T>
+void MultiProducerHeterogeneousQueue<T>::installNextBlock(Block& block, size_t offset, size_t envelopeSize)
+{
+    std::lock_guard<std::mutex> lock{blockMutex_};
+
+    // Next block needs to fit at least the element that didn't fit in this one
+    Block* next = nullptr;
+    try
+    {
+        next = acquireBlock(envelopeSize + BLOCK_END_SIZE, block.sizeInBytes_);
+    }
+    catch (...)
+    {
+        // Drop the reservations past the limit, including ours, so that the next writer tries again
+        writeCursor_.store((static_cast<uint64_t>(block.index_) << BLOCK_INDEX_SHIFT) | offset,
+                           std::memory_order_release);
+        throw;
+    }
+
+    writeCursor_.store(static_cast<uint64_t>(next->index_) << BLOCK_INDEX_SHIFT, std::memory_order_release);
+    publish(new (block.buffer_.get() + offset) BlockEnd(next));
+}
+
+template <typename T>
+typename MultiProducerHeterogeneousQueue<T>::Block* MultiProducerHeterogeneousQueue<T>::acquireBlock(
+    size_t minimumSize,
+    size_t currentSize)
+{
+    auto reusable = std::find_if(
+        freeBlocks_.begin(), freeBlocks_.end(), [minimumSize](Block* b) { return b->sizeInBytes_ >= minimumSize; });
+    if (reusable != freeBlocks_.end())
+    {
+        Block* block = *reusable;
+        freeBlocks_.erase(reusable);
+        return block;
+    }
+
+    size_t largestSize = currentSize;
+    for (size_t i = 0; i < blockCount_; ++i)
+    {
+        largestSize = std::max(largestSize, blocks_[i]->sizeInBytes_);
+    }
+
+    if (blockCount_ == MAX_BLOCKS)
+        throw std::length_error("MultiProducerHeterogeneousQueue: too many blocks");
+
+    const size_t index = blockCount_;
+    const size_t sizeInBytes = std::max(largestSize * 2, minimumSize);
+    blocks_[index] = std::make_unique<Block>(index, sizeInBytes, allocateBuffer_(sizeInBytes));
+    ++blockCount_; // Only once allocated
+    return blocks_[index].get();
+}
+
+template <typename T>
+const typename MultiProducerHeterogeneousQueue<T>::Envelope* MultiProducerHeterogeneousQueue<T>::currentEnvelope()
+    const
+{
+    return reinterpret_cast<const Envelope*>(readBlock_->buffer_.get() + readOffset_);
+}
+
+template <typename T>
+bool MultiProducerHeterogeneousQueue<T>::hasElement()
+{
+    while (currentEnvelope()->ready_.load(std::memory_order_acquire))
+    {
+        switch (currentEnvelope()->kind_)
+        {
+            case Envelope::Kind::Element:
+                return true;
+            case Envelope::Kind::Skip:
+                skipCurrentEnvelope();
+                break;
+            case Envelope::Kind::BlockEnd:
+                moveToNextBlock();
+                break;
+        }
+    }
+
+    return false;
+}
+
+template <typename T>
+void MultiProducerHeterogeneousQueue<T>::moveToNextBlock()
+{
+    const BlockEnd* end = static_cast<const BlockEnd*>(currentEnvelope());
+    Block* readBlock = readBlock_;
+    const size_t usedSize = readOffset_ + end->size_;
+
+    readBlock_ = end->next_;
+    readOffset_ = 0;
+
+    // All writes to the block are done, clear ready flags for reuse
+    std::memset(readBlock->buffer_.get(), 0, usedSize);
+
+    std::lock_guard<std::mutex> lock{blockMutex_};
+    freeBlocks_.push_back(readBlock);
+}
+
+template <typename T>
+void MultiProducerHeterogeneousQueue<T>::skipCurrentEnvelope()
+{
+    readOffset_ += currentEnvelope()->size_;
+}
+
+template <typename T>
+void MultiProducerHeterogeneousQueue<T>::releaseHeldEnvelope()
+{
+    if (hasCurrentEnvelope_)
+    {
+        const Envelope& envelope = *currentEnvelope();
+        if (envelope.ops_->destroy_)
+            envelope.ops_->destroy_(envelope);
+        skipCurrentEnvelope();
+        hasCurrentEnvelope_ = false;
+    }
+}
+
+template <typename T>
+const T& MultiProducerHeterogeneousQueue<T>::holdCurrentEnvelope()
+{
+    hasCurrentEnvelope_ = true;
+    return *currentEnvelope()->ops_->get_(*currentEnvelope());
+}
+
+} // namespace Data
@@ -1,8 +1,14 @@
 #pragma once
 
-#include <functional>
+#include "common/Delegate.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace Data {
 
@@ -15,6 +21,19 @@ namespace Data {
  * - taking in the data as const reference, or
  * - taking in the data by value (copy)
  *
+ * Subscribers are kept in a contiguous array with their callbacks stored in place as
+ * Common::Delegate, so notifying is a linear pass over the array.
+ *
+ * Thread-safe. The subscriber array is immutable: subscribing and unsubscribing replace it
+ * with an updated copy, so notifying takes no lock and may run in several threads at once.
+ * A replaced array is freed once the notifications which might still use it have finished,
+ * by a later update, the last of those notifications or the destructor. Nothing waits for
+ * notifications to finish, so subscribing and unsubscribing never block on a callback.
+ *
+ * Notifications starting after unsubscribe returns don't call the subscriber anymore, but
+ * notifications already in progress in other threads may still do so. A subscriber must
+ * stay alive until those have finished, which waitForNotifications can be used for.
+ *
  * @tparam DataType The data type
  */
 template <typename DataType>
@@ -76,15 +95,48 @@ public:
      */
     void notifySubscribers(const DataType& data);
 
+    /**
+     * Wait for the notifications in progress to finish, e.g. before destroying an unsubscribed
+     * subscriber. Must not be called from a notification of this publisher, nor while holding
+     * a lock a subscriber may take when notified.
+     */
+    void waitForNotifications();
+
 private:
     /** Prevent copy, move and assignment */
     Publisher(const Publisher&);
     Publisher(Publisher&&);
     Publisher& operator=(const Publisher&);
 
-    using NotificationFunction = const std::function<void(const DataType&)>;
-    using SubscriberMap = std::map<void*, NotificationFunction>;
-    SubscriberMap subscribers_;
+    using NotificationFunction = Common::Delegate<void(const DataType&)>;
+
+    /** Subscriber identifier with its notification function */
+    struct Subscriber
+    {
+        void* object_;
+        NotificationFunction notify_;
+    };
+
+    using SubscriberList = std::vector<Subscriber>;
+
+    std::atomic<const SubscriberList*> subscribers_; ///< Current immutable subscriber list
+
+    /** Notifications in progress, counted by the parity of the epoch they started in */
+    ///@{
+    std::atomic<size_t> epoch_;
+    std::array<std::atomic<size_t>, 2> activeNotifications_;
+    ///@}
+
+    /** Replaced subscriber list with the epoch it was replaced in */
+    struct RetiredList
+    {
+        std::unique_ptr<const SubscriberList> list_;
+        size_t epoch_;
+    };
+
+    std::mutex updateMutex_; ///< Serializes replacing the subscriber list and advancing the epoch
+    std::vector<RetiredList> retiredLists_; ///< Replaced lists, needs updateMutex_
+    std::atomic<bool> hasRetiredLists_; ///< Whether retiredLists_ is non-empty
 
     /**
      * Add new subscriber.
@@ -102,56 +154,66 @@ private:
      * @return True if the unsubscription was successful, false if the subscriber did not exist
      */
     bool removeSubscriber(void* object);
+
+    /** @return Subscriber of @p object in @p subscribers, or end */
+    static typename SubscriberList::const_iterator findSubscriber(const SubscriberList& subscribers, void* object);
+
+    /** Make @p subscribers current and retire the previous list. Needs updateMutex_. */
+    void replaceSubscribers(std::unique_ptr<SubscriberList> subscribers);
+
+    /** Advance the epoch if the notifications of the previous epoch have finished. Needs updateMutex_. */
+    bool advanceEpoch();
+
+    /**
+     * Advance the epoch as far as finished notifications allow and free the retired lists
+     * no notification can use anymore. Never waits. Needs updateMutex_.
+     */
+    void reclaimRetiredLists();
+
+    /** Reclaim after the last notification registered in @p epochParity has finished */
+    void notificationsFinished(size_t epochParity);
 };
 
 template <typename DataType>
 template <typename SubscriberType, typename InterfaceType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (InterfaceType::*callback)(const DataType&))
 {
-    const std::function<void(const DataType&)> f = [&object, callback](const DataType& data) {
-        (object.*callback)(data);
-    };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromMember(object, callback));
 }
 
 template <typename DataType>
 template <typename SubscriberType, typename InterfaceType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (InterfaceType::*callback)(DataType))
 {
-    std::function<void(const DataType&)> f = [&object, callback](const DataType& data) { (object.*callback)(data); };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromMember(object, callback));
 }
 
 template <typename DataType>
 template <typename SubscriberType, typename InterfaceType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (InterfaceType::*callback)())
 {
-    std::function<void(const DataType&)> f = [&object, callback](const DataType& data) { (object.*callback)(); };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromMember(object, callback));
 }
 
 template <typename DataType>
 template <typename SubscriberType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (*callback)(const DataType&))
 {
-    std::function<void(const DataType&)> f = [callback](const DataType& data) { callback(data); };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromFunction(callback));
 }
 
 template <typename DataType>
 template <typename SubscriberType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (*callback)(DataType))
 {
-    std::function<void(const DataType&)> f = [callback](const DataType& data) { callback(data); };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromFunction(callback));
 }
 
 template <typename DataType>
 template <typename SubscriberType, typename ReturnType>
 bool Publisher<DataType>::subscribe(SubscriberType& object, ReturnType (*callback)())
 {
-    std::function<void(const DataType&)> f = [callback](const DataType& data) { callback(); };
-    return addSubscriber(&object, f);
+    return addSubscriber(&object, NotificationFunction::fromFunction(callback));
 }
 
 template <typename DataType>
@@ -162,40 +224,187 @@ bool Publisher<DataType>::unsubscribe(Object& object)
 }
 
 template <typename DataType>
-Publisher<DataType>::Publisher() : subscribers_()
+Publisher<DataType>::Publisher()
+  : subscribers_{new SubscriberList()},
+    epoch_{0},
+    activeNotifications_{},
+    updateMutex_(),
+    retiredLists_(),
+    hasRetiredLists_{false}
 {
 }
 
 template <typename DataType>
-Publisher<DataType>::~Publisher() = default;
+Publisher<DataType>::~Publisher()
+{
+    delete subscribers_.load();
+}
 
 template <typename DataType>
 void Publisher<DataType>::notifySubscribers(const DataType& data)
 {
-    for (auto& sub : subscribers_)
-        sub.second(data);
+    /** Registers the notification for its duration, also when a subscriber throws */
+    class Notification
+    {
+    public:
+        explicit Notification(Publisher& publisher)
+          : publisher_(publisher),
+            parity_(publisher.epoch_.load(std::memory_order_seq_cst) & 1)
+        {
+            publisher_.activeNotifications_[parity_].fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~Notification()
+        {
+            if (publisher_.activeNotifications_[parity_].fetch_sub(1, std::memory_order_seq_cst) == 1)
+                publisher_.notificationsFinished(parity_);
+        }
+
+    private:
+        Publisher& publisher_;
+        const size_t parity_;
+    };
+
+    const Notification notification{*this};
+
+    // Loaded after registering, so the list stays alive until the notification ends
+    for (const auto& sub : *subscribers_.load(std::memory_order_seq_cst))
+        sub.notify_(data);
+}
+
+template <typename DataType>
+void Publisher<DataType>::waitForNotifications()
+{
+    size_t target;
+    {
+        std::lock_guard<std::mutex> lock{updateMutex_};
+        target = epoch_.load(std::memory_order_relaxed) + 2;
+    }
+
+    // The update lock is not held while waiting, so notifications may subscribe and unsubscribe
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock{updateMutex_};
+            if (epoch_.load(std::memory_order_relaxed) >= target)
+            {
+                reclaimRetiredLists();
+                return;
+            }
+            if (advanceEpoch())
+                continue;
+        }
+        std::this_thread::yield();
+    }
 }
 
 template <typename DataType>
 bool Publisher<DataType>::addSubscriber(void* object, const NotificationFunction& notifyFunction)
 {
-    if (!subscribers_.emplace(object, notifyFunction).second)
     {
-        std::cerr << "Failed to add subscriber: duplicate" << std::endl;
-        return false;
+        std::lock_guard<std::mutex> lock{updateMutex_};
+        const SubscriberList& current = *subscribers_.load(std::memory_order_relaxed);
+
+        if (findSubscriber(current, object) != current.end())
+        {
+            std::cerr << "Failed to add subscriber: duplicate" << std::endl;
+            return false;
+        }
+
+        auto updated = std::make_unique<SubscriberList>();
+        updated->reserve(current.size() + 1);
+        updated->assign(current.begin(), current.end());
+        updated->push_back(Subscriber{object, notifyFunction});
+        replaceSubscribers(std::move(updated));
+        reclaimRetiredLists();
     }
+
     return true;
 }
 
 template <typename DataType>
 bool Publisher<DataType>::removeSubscriber(void* object)
 {
-    if (subscribers_.erase(object) < 1)
     {
-        std::cerr << "Failed to remove subscriber: non-existent" << std::endl;
-        return false;
+        std::lock_guard<std::mutex> lock{updateMutex_};
+        const SubscriberList& current = *subscribers_.load(std::memory_order_relaxed);
+
+        const auto found = findSubscriber(current, object);
+        if (found == current.end())
+        {
+            std::cerr << "Failed to remove subscriber: non-existent" << std::endl;
+            return false;
+        }
+
+        auto updated = std::make_unique<SubscriberList>();
+        updated->reserve(current.size() - 1);
+        updated->insert(updated->end(), current.begin(), found);
+        updated->insert(updated->end(), std::next(found), current.end());
+        replaceSubscribers(std::move(updated));
+        reclaimRetiredLists();
     }
+
     return true;
 }
 
+template <typename DataType>
+typename Publisher<DataType>::SubscriberList::const_iterator Publisher<DataType>::findSubscriber(
+    const SubscriberList& subscribers, void* object)
+{
+    return std::find_if(
+        subscribers.begin(), subscribers.end(), [object](const Subscriber& sub) { return sub.object_ == object; });
+}
+
+template <typename DataType>
+void Publisher<DataType>::replaceSubscribers(std::unique_ptr<SubscriberList> subscribers)
+{
+    const SubscriberList* previous = subscribers_.exchange(subscribers.release(), std::memory_order_seq_cst);
+    retiredLists_.push_back(RetiredList{std::unique_ptr<const SubscriberList>(previous), epoch_.load()});
+    hasRetiredLists_.store(true, std::memory_order_seq_cst);
+}
+
+template <typename DataType>
+bool Publisher<DataType>::advanceEpoch()
+{
+    const size_t epoch = epoch_.load(std::memory_order_seq_cst);
+    if (activeNotifications_[(epoch + 1) & 1].load(std::memory_order_seq_cst) != 0)
+        return false;
+
+    epoch_.store(epoch + 1, std::memory_order_seq_cst);
+    return true;
+}
+
+template <typename DataType>
+void Publisher<DataType>::reclaimRetiredLists()
+{
+    // A notification registers in the counter of the epoch it started in. The epoch may advance
+    // once the counter of the previous epoch has drained, so when the epoch has advanced twice
+    // since a list was retired, the notifications which started before that have all finished.
+    // Notifications registering late, in a counter of an already advanced epoch, load the list
+    // only after registering and so can't see a list retired before the advance.
+    for (int phase = 0; phase < 2 && !retiredLists_.empty(); ++phase)
+    {
+        if (!advanceEpoch())
+            break;
+    }
+
+    const size_t epoch = epoch_.load(std::memory_order_relaxed);
+    retiredLists_.erase(
+        std::remove_if(retiredLists_.begin(), retiredLists_.end(),
+                       [epoch](const RetiredList& retired) { return epoch - retired.epoch_ >= 2; }),
+        retiredLists_.end());
+    hasRetiredLists_.store(!retiredLists_.empty(), std::memory_order_seq_cst);
+}
+
+template <typename DataType>
+void Publisher<DataType>::notificationsFinished(size_t epochParity)
+{
+    if (!hasRetiredLists_.load(std::memory_order_seq_cst))
+        return;
+
+    // Never waits: if an update holds the lock, it reclaims itself
+    std::unique_lock<std::mutex> lock{updateMutex_, std::try_to_lock};
+    if (lock.owns_lock() && activeNotifications_[epochParity].load(std::memory_order_seq_cst) == 0)
+        reclaimRetiredLists();
+}
+
 } // namespace Data
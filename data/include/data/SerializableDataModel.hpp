@@ -17,6 +17,7 @@ public:
     /** @defgroup SerializableDataModelIf implementation */
     ///@{
     virtual void set(const DataType& data) override;
+    virtual void set(DataType&& data) override;
     virtual const DataType& get() const override;
     virtual Publisher<DataType>& publisher() override;
 
@@ -50,6 +51,12 @@ void SerializableDataModel<DataType, Less>::set(const DataType& data)
     dataModel_.set(data);
 }
 
+template <typename DataType, typename Less>
+void SerializableDataModel<DataType, Less>::set(DataType&& data)
+{
+    dataModel_.set(std::move(data));
+}
+
 template <typename DataType, typename Less>
 const DataType& SerializableDataModel<DataType, Less>::get() const
 {
@@ -78,7 +85,7 @@ bool SerializableDataModel<DataType, Less>::deserialize(std::istream& input)
     if (result)
     {
         // Uses setInternal instead of set to prevent notification, which is sent in deserializationComplete
-        dataModel_.setInternal(deserializedData);
+        dataModel_.setInternal(std::move(deserializedData));
     }
     return result;
 }
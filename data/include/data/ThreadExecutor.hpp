@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ExecutorIf.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Data {
+
+/**
+ * Executor running tasks in its own threads.
+ *
+ * With a single thread the tasks run one at a time in the order they were posted,
+ * so it can serve as the delivery queue of a subscriber.
+ */
+class ThreadExecutor : public ExecutorIf
+{
+public:
+    /** Start @p threadCount threads */
+    explicit ThreadExecutor(size_t threadCount = 1);
+
+    /** Run the tasks already posted and stop the threads */
+    ~ThreadExecutor() override;
+
+    void post(std::function<void()> task) override;
+
+private:
+    /** Thread main loop */
+    void run();
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()>> tasks_; ///< Needs mutex_
+    bool stopping_;                           ///< Needs mutex_
+    std::vector<std::thread> threads_;
+};
+
+inline ThreadExecutor::ThreadExecutor(size_t threadCount)
+  : mutex_(), condition_(), tasks_(), stopping_(false), threads_()
+{
+    threads_.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        threads_.emplace_back([this] { run(); });
+    }
+}
+
+inline ThreadExecutor::~ThreadExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+inline void ThreadExecutor::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        tasks_.push_back(std::move(task));
+    }
+    condition_.notify_one();
+}
+
+inline void ThreadExecutor::run()
+{
+    std::unique_lock<std::mutex> lock{mutex_};
+    for (;;)
+    {
+        condition_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty())
+            return;
+
+        std::function<void()> task = std::move(tasks_.front());
+        tasks_.pop_front();
+
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+} // namespace Data
@@ -0,0 +1,187 @@
+#include "data/AsyncSubscriber.hpp"
+#include "data/DataModel.hpp"
+#include "data/ThreadExecutor.hpp"
+#include "test_util/LogHelpers.hpp"
+#include "test_util/ManualExecutor.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Data {
+
+namespace {
+
+/** Subscriber recording the delivered values */
+class Recorder
+{
+public:
+    void record(const int& value)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        values_.push_back(value);
+        threads_.push_back(std::this_thread::get_id());
+        condition_.notify_all();
+    }
+
+    /** Wait until @p count values are delivered */
+    bool waitFor(size_t count)
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        return condition_.wait_for(lock, std::chrono::seconds(10), [&] { return values_.size() >= count; });
+    }
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<int> values_;
+    std::vector<std::thread::id> threads_;
+};
+
+/** Recorder throwing after recording the odd values */
+class ThrowingRecorder : public Recorder
+{
+public:
+    void record(const int& value)
+    {
+        Recorder::record(value);
+        if (value % 2 != 0)
+            throw std::runtime_error("odd value");
+    }
+};
+
+using Callback = AsyncSubscriber<int>::Callback;
+
+} // anonymous namespace
+
+TEST(AsyncSubscriber, DeliverEveryValue)
+{
+    DataModel<int> model;
+    ManualExecutor executor;
+    Recorder recorder;
+    AsyncSubscriber<int> subscription(
+        model.publisher(), executor, Callback::fromMember(recorder, &Recorder::record), Delivery::Every);
+
+    model.set(1);
+    model.set(2);
+    model.set(3);
+    EXPECT_TRUE(recorder.values_.empty());
+    EXPECT_EQ(1u, executor.tasks_.size());
+
+    executor.runAll();
+    EXPECT_EQ(std::vector<int>({1, 2, 3}), recorder.values_);
+}
+
+TEST(AsyncSubscriber, DeliverLatestValue)
+{
+    DataModel<int> model;
+    ManualExecutor executor;
+    Recorder recorder;
+    AsyncSubscriber<int> subscription(
+        model.publisher(), executor, Callback::fromMember(recorder, &Recorder::record), Delivery::Latest);
+
+    model.set(1);
+    model.set(2);
+    model.set(3);
+    executor.runAll();
+
+    model.set(4);
+    executor.runAll();
+
+    EXPECT_EQ(std::vector<int>({3, 4}), recorder.values_);
+}
+
+TEST(AsyncSubscriber, DeliverInExecutorThread)
+{
+    DataModel<int> model;
+    Recorder recorder;
+    ThreadExecutor executor;
+    {
+        AsyncSubscriber<int> subscription(
+            model.publisher(), executor, Callback::fromMember(recorder, &Recorder::record), Delivery::Every);
+
+        for (int i = 1; i <= 100; ++i)
+        {
+            model.set(i);
+        }
+        ASSERT_TRUE(recorder.waitFor(100));
+    }
+
+    std::vector<int> expected;
+    for (int i = 1; i <= 100; ++i)
+    {
+        expected.push_back(i);
+    }
+    EXPECT_EQ(expected, recorder.values_);
+    EXPECT_NE(std::this_thread::get_id(), recorder.threads_.front());
+}
+
+TEST(AsyncSubscriber, DestructorWaitsForDeliveries)
+{
+    DataModel<int> model;
+    Recorder recorder;
+    ThreadExecutor executor(2);
+    {
+        AsyncSubscriber<int> subscription(
+            model.publisher(), executor, Callback::fromMember(recorder, &Recorder::record), Delivery::Latest);
+
+        for (int i = 1; i <= 100; ++i)
+        {
+            model.set(i);
+        }
+    }
+
+    // The latest value is always delivered
+    ASSERT_FALSE(recorder.values_.empty());
+    EXPECT_EQ(100, recorder.values_.back());
+
+    model.set(101);
+    EXPECT_EQ(100, recorder.values_.back());
+}
+
+TEST(AsyncSubscriber, ThrowingCallbackDoesNotStopDelivery)
+{
+    Common::ExpectErrorLog errorLog;
+    DataModel<int> model;
+    ManualExecutor executor;
+    ThrowingRecorder recorder;
+    AsyncSubscriber<int> subscription(
+        model.publisher(), executor, Callback::fromMember(recorder, &ThrowingRecorder::record), Delivery::Every);
+
+    model.set(1);
+    model.set(2);
+    model.set(3);
+    executor.runAll();
+
+    model.set(4);
+    EXPECT_EQ(1u, executor.tasks_.size());
+    executor.runAll();
+
+    EXPECT_EQ(std::vector<int>({1, 2, 3, 4}), recorder.values_);
+}
+
+TEST(AsyncSubscriber, ThrowingCallbackInExecutorThread)
+{
+    Common::ExpectErrorLog errorLog;
+    DataModel<int> model;
+    ThrowingRecorder recorder;
+    ThreadExecutor executor;
+    {
+        AsyncSubscriber<int> subscription(
+            model.publisher(), executor, Callback::fromMember(recorder, &ThrowingRecorder::record), Delivery::Every);
+
+        for (int i = 1; i <= 100; ++i)
+        {
+            model.set(i);
+        }
+        ASSERT_TRUE(recorder.waitFor(100));
+    }
+
+    EXPECT_EQ(100u, recorder.values_.size());
+    EXPECT_EQ(100, recorder.values_.back());
+}
+
+} // namespace Data
@@ -60,4 +60,47 @@ TEST(ConcreteQueue, BasicIntQueueMultipleThreads)
     producer.join();
 }
 
+TEST(ConcreteQueue, NonBlockingIntQueue)
+{
+    ConcreteQueue<int> queue;
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+
+    queue.enqueue(42);
+    queue.enqueue(33);
+
+    const int* element = queue.tryDequeue();
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(42, *element);
+
+    element = queue.tryDequeue();
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(33, *element);
+
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ConcreteQueue, TimedDequeueIntQueue)
+{
+    ConcreteQueue<int> queue;
+    EXPECT_EQ(nullptr, queue.dequeueFor(std::chrono::milliseconds(1)));
+    EXPECT_EQ(nullptr, queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(1)));
+
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.enqueue(42);
+        queue.enqueue(33);
+    });
+
+    const int* element = queue.dequeueFor(std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(42, *element);
+
+    element = queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(33, *element);
+
+    producer.join();
+}
+
 } // namespace Data
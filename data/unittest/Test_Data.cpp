@@ -1,5 +1,7 @@
 #include "data/Data.hpp"
 #include "gtest/gtest.h"
+#include <string>
+#include <vector>
 
 namespace Data {
 
@@ -34,4 +36,15 @@ TEST(DataTest, setAndGet)
     EXPECT_EQ(2, data.get());
 }
 
+TEST(DataTest, setByMoving)
+{
+    std::vector<int> values(100, 1);
+    const int* buffer = values.data();
+
+    Data<std::vector<int>> data;
+    data.set(std::move(values));
+
+    EXPECT_EQ(buffer, data.get().data());
+}
+
 } // namespace Data
@@ -2,6 +2,12 @@
 #include "data/DataModel.hpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 
 using namespace testing;
 
@@ -170,6 +176,55 @@ TEST_F(IntDataModelTest, publishOnlyWhenRequested)
     EXPECT_TRUE(pub.unsubscribe(sub));
 }
 
+TEST_F(IntDataModelTest, setByMoving)
+{
+    DataModel<std::vector<int>> model;
+    StrictMock<Subscriber<std::vector<int>>> vectorSub;
+    EXPECT_TRUE(model.publisher().subscribe(vectorSub, &Subscriber<std::vector<int>>::notifyEmpty));
+
+    std::vector<int> values(100, 1);
+    const int* buffer = values.data();
+
+    EXPECT_CALL(vectorSub, notifyEmpty());
+    model.set(std::move(values));
+    EXPECT_EQ(buffer, model.get().data());
+
+    // Unchanged value is not published
+    model.set(std::vector<int>(100, 1));
+
+    EXPECT_TRUE(model.publisher().unsubscribe(vectorSub));
+}
+
+TEST_F(StringDataModelTest, emplace)
+{
+    EXPECT_TRUE(pub.subscribe(sub, &Subscriber<std::string>::notifyReference));
+
+    EXPECT_CALL(sub, notifyReference("xxx"));
+    data.emplace(3, 'x');
+    EXPECT_EQ("xxx", data.get());
+
+    EXPECT_TRUE(pub.unsubscribe(sub));
+}
+
+TEST_F(StringDataModelTest, modify)
+{
+    EXPECT_TRUE(pub.subscribe(sub, &Subscriber<std::string>::notifyReference));
+
+    EXPECT_CALL(sub, notifyReference("a"));
+    data.modify([](std::string& value) { value += "a"; });
+
+    // Not published when reported unchanged
+    data.modify([](std::string&) { return false; });
+
+    EXPECT_CALL(sub, notifyReference("ab"));
+    data.modify([](std::string& value) {
+        value += "b";
+        return true;
+    });
+
+    EXPECT_TRUE(pub.unsubscribe(sub));
+}
+
 TEST_F(IntDataModelTest, doubleSubscribe)
 {
     EXPECT_TRUE(pub.subscribe(sub, &notifyFuncEmpty<int>));
@@ -188,4 +243,392 @@ TEST_F(IntDataModelTest, doubleSubscribe)
     }
 }
 
+TEST_F(IntDataModelTest, manySubscribers)
+{
+    std::vector<StrictMock<Subscriber<int>>> subs(100);
+    for (auto& s : subs)
+    {
+        EXPECT_TRUE(pub.subscribe(s, &Subscriber<int>::notifyReference));
+    }
+    EXPECT_TRUE(pub.unsubscribe(subs[50]));
+
+    {
+        InSequence sequence;
+        for (size_t i = 0; i < subs.size(); ++i)
+        {
+            if (i != 50)
+            {
+                EXPECT_CALL(subs[i], notifyReference(7));
+            }
+        }
+    }
+    data.set(7);
+
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        if (i != 50)
+        {
+            EXPECT_TRUE(pub.unsubscribe(subs[i]));
+        }
+    }
+}
+
+namespace {
+
+/** Subscriber unsubscribing itself when notified */
+class SelfUnsubscriber
+{
+public:
+    explicit SelfUnsubscriber(Publisher<int>& pub) : pub_(pub), notifications_(0) {}
+
+    void notify()
+    {
+        ++notifications_;
+        EXPECT_TRUE(pub_.unsubscribe(*this));
+    }
+
+    Publisher<int>& pub_;
+    int notifications_;
+};
+
+/** Subscriber counting its notifications */
+class CountingSubscriber
+{
+public:
+    void notify(const int&) { ++notifications_; }
+
+    std::atomic<int> notifications_{0};
+};
+
+/** Subscriber taking a lock when notified */
+class LockingSubscriber
+{
+public:
+    explicit LockingSubscriber(std::mutex& mutex) : mutex_(mutex) {}
+
+    void notify()
+    {
+        entered_ = true;
+        std::lock_guard<std::mutex> lock{mutex_};
+    }
+
+    std::mutex& mutex_;
+    std::atomic<bool> entered_{false};
+};
+
+} // anonymous namespace
+
+TEST_F(IntDataModelTest, unsubscribeDuringNotification)
+{
+    SelfUnsubscriber first(pub);
+    SelfUnsubscriber second(pub);
+    EXPECT_TRUE(pub.subscribe(first, &SelfUnsubscriber::notify));
+    EXPECT_TRUE(pub.subscribe(second, &SelfUnsubscriber::notify));
+
+    data.set(1);
+    data.set(2);
+
+    EXPECT_EQ(1, first.notifications_);
+    EXPECT_EQ(1, second.notifications_);
+}
+
+TEST_F(IntDataModelTest, concurrentSubscriptionsAndNotifications)
+{
+    static const int notifierCount = 2;
+    static const int rounds = 200;
+
+    std::vector<CountingSubscriber> subs(4);
+    std::atomic<bool> done{false};
+
+    std::vector<std::thread> notifiers;
+    for (int n = 0; n < notifierCount; ++n)
+    {
+        notifiers.emplace_back([this, &done] {
+            while (!done)
+            {
+                pub.notifySubscribers(1);
+            }
+        });
+    }
+
+    for (int round = 0; round < rounds; ++round)
+    {
+        for (auto& s : subs)
+        {
+            EXPECT_TRUE(pub.subscribe(s, &CountingSubscriber::notify));
+        }
+        for (auto& s : subs)
+        {
+            EXPECT_TRUE(pub.unsubscribe(s));
+        }
+    }
+
+    done = true;
+    for (auto& notifier : notifiers)
+    {
+        notifier.join();
+    }
+
+    // Notifications starting after unsubscribing don't reach the subscribers
+    std::vector<int> counts;
+    for (auto& s : subs)
+    {
+        counts.push_back(s.notifications_);
+    }
+    pub.notifySubscribers(1);
+    for (size_t i = 0; i < subs.size(); ++i)
+    {
+        EXPECT_EQ(counts[i], subs[i].notifications_);
+    }
+}
+
+TEST_F(IntDataModelTest, unsubscribeWhileNotifyingInOtherThread)
+{
+    std::mutex mutex;
+    LockingSubscriber sub(mutex);
+    EXPECT_TRUE(pub.subscribe(sub, &LockingSubscriber::notify));
+
+    std::unique_lock<std::mutex> lock{mutex};
+    std::thread notifier([this] { pub.notifySubscribers(1); });
+    while (!sub.entered_)
+    {
+        std::this_thread::yield();
+    }
+
+    // Must not wait for the notification blocked on the lock held here
+    EXPECT_TRUE(pub.unsubscribe(sub));
+    EXPECT_TRUE(pub.subscribe(sub, &LockingSubscriber::notify));
+    EXPECT_TRUE(pub.unsubscribe(sub));
+
+    lock.unlock();
+    notifier.join();
+}
+
+TEST_F(IntDataModelTest, waitForNotificationsInOtherThread)
+{
+    std::mutex mutex;
+    LockingSubscriber sub(mutex);
+    EXPECT_TRUE(pub.subscribe(sub, &LockingSubscriber::notify));
+
+    std::unique_lock<std::mutex> lock{mutex};
+    std::atomic<bool> notified{false};
+    std::thread notifier([this, &notified] {
+        pub.notifySubscribers(1);
+        notified = true;
+    });
+    while (!sub.entered_)
+    {
+        std::this_thread::yield();
+    }
+
+    EXPECT_TRUE(pub.unsubscribe(sub));
+    std::thread waiter([this, &notified] {
+        pub.waitForNotifications();
+        EXPECT_TRUE(notified.load());
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    lock.unlock();
+    waiter.join();
+    notifier.join();
+}
+
+namespace {
+
+/** Value counting the comparisons and copies made */
+struct Counted
+{
+    Counted(int value) : value_(value) {}
+    Counted(const Counted& other) : value_(other.value_) { ++copyCount; }
+    Counted(Counted&&) = default;
+    Counted& operator=(const Counted& other)
+    {
+        value_ = other.value_;
+        ++copyCount;
+        return *this;
+    }
+    Counted& operator=(Counted&&) = default;
+
+    int value_;
+
+    static int equalCount;
+    static int lessCount;
+    static int hashCount;
+    static int copyCount;
+};
+int Counted::equalCount = 0;
+int Counted::lessCount = 0;
+int Counted::hashCount = 0;
+int Counted::copyCount = 0;
+
+bool operator==(const Counted& a, const Counted& b)
+{
+    ++Counted::equalCount;
+    return a.value_ == b.value_;
+}
+
+bool operator<(const Counted& a, const Counted& b)
+{
+    ++Counted::lessCount;
+    return a.value_ < b.value_;
+}
+
+struct CountedHash
+{
+    size_t operator()(const Counted& c) const
+    {
+        ++Counted::hashCount;
+        return static_cast<size_t>(c.value_);
+    }
+};
+
+/** Value without ordering */
+struct Point
+{
+    int x_;
+    int y_;
+
+    bool operator==(const Point& other) const { return x_ == other.x_ && y_ == other.y_; }
+};
+
+void resetCounts()
+{
+    Counted::equalCount = 0;
+    Counted::lessCount = 0;
+    Counted::hashCount = 0;
+    Counted::copyCount = 0;
+}
+
+} // anonymous namespace
+
+TEST(DataModelChangeDetection, defaultUsesEquality)
+{
+    DataModel<Counted> model(Counted{1});
+    resetCounts();
+
+    model.set(Counted{1});
+    model.set(Counted{2});
+
+    EXPECT_EQ(2, Counted::equalCount);
+    EXPECT_EQ(0, Counted::lessCount);
+    EXPECT_EQ(2, model.get().value_);
+}
+
+TEST(DataModelChangeDetection, typeWithoutOrdering)
+{
+    DataModel<Point> model(Point{1, 2});
+    StrictMock<Subscriber<Point>> pointSub;
+    EXPECT_TRUE(model.publisher().subscribe(pointSub, &Subscriber<Point>::notifyEmpty));
+
+    model.set(Point{1, 2});
+    EXPECT_CALL(pointSub, notifyEmpty());
+    model.set(Point{2, 2});
+
+    EXPECT_TRUE(model.publisher().unsubscribe(pointSub));
+}
+
+TEST(DataModelChangeDetection, lessDetector)
+{
+    DataModel<Counted, std::less<Counted>, LessChangeDetector<Counted>> model(Counted{1});
+    resetCounts();
+
+    model.set(Counted{1});
+
+    EXPECT_EQ(0, Counted::equalCount);
+    EXPECT_EQ(2, Counted::lessCount);
+}
+
+TEST(DataModelChangeDetection, hashDetector)
+{
+    DataModel<Counted, std::less<Counted>, HashChangeDetector<Counted, CountedHash>> model(Counted{1});
+    StrictMock<Subscriber<Counted>> countedSub;
+    EXPECT_TRUE(model.publisher().subscribe(countedSub, &Subscriber<Counted>::notifyEmpty));
+    resetCounts();
+
+    // Different hash, current value not compared
+    EXPECT_CALL(countedSub, notifyEmpty());
+    model.set(Counted{2});
+    EXPECT_EQ(1, Counted::hashCount);
+    EXPECT_EQ(0, Counted::equalCount);
+
+    // Same hash, confirmed by comparing
+    model.set(Counted{2});
+    EXPECT_EQ(2, Counted::hashCount);
+    EXPECT_EQ(1, Counted::equalCount);
+
+    // Cached hash follows in-place modifications
+    EXPECT_CALL(countedSub, notifyEmpty());
+    model.modify([](Counted& c) { c.value_ = 3; });
+    model.set(Counted{3});
+    EXPECT_EQ(3, model.get().value_);
+
+    EXPECT_TRUE(model.publisher().unsubscribe(countedSub));
+}
+
+TEST(DataModelChangeDetection, hashDetectorFollowsFailedModify)
+{
+    DataModel<Counted, std::less<Counted>, HashChangeDetector<Counted, CountedHash>> model(Counted{1});
+    StrictMock<Subscriber<Counted>> countedSub;
+    EXPECT_TRUE(model.publisher().subscribe(countedSub, &Subscriber<Counted>::notifyEmpty));
+
+    EXPECT_THROW(model.modify([](Counted& c) {
+        c.value_ = 2;
+        throw std::runtime_error("modification failed");
+    }),
+                 std::runtime_error);
+    EXPECT_EQ(2, model.get().value_);
+
+    // Failed modification is left unpublished
+    EXPECT_CALL(countedSub, notifyEmpty());
+    model.publishPendingChanges();
+    Mock::VerifyAndClearExpectations(&countedSub);
+
+    // Setting the current value is no change
+    model.set(Counted{2});
+
+    EXPECT_TRUE(model.publisher().unsubscribe(countedSub));
+}
+
+TEST(DataModelChangeDetection, revertedChangesAreNotPublished)
+{
+    DataModel<Counted, std::less<Counted>, HashChangeDetector<Counted, CountedHash>> model(Counted{1});
+    StrictMock<Subscriber<Counted>> countedSub;
+    EXPECT_TRUE(model.publisher().subscribe(countedSub, &Subscriber<Counted>::notifyEmpty));
+
+    model.keepPublishedValue();
+    model.setInternal(Counted{2});
+    model.setInternal(Counted{1});
+    model.publishPendingChanges();
+
+    // Detector still tracks the current value
+    model.set(Counted{1});
+    EXPECT_CALL(countedSub, notifyEmpty());
+    model.set(Counted{2});
+
+    EXPECT_TRUE(model.publisher().unsubscribe(countedSub));
+}
+
+TEST(DataModelChangeDetection, setDoesNotCopy)
+{
+    DataModel<Counted> model(Counted{1});
+    StrictMock<Subscriber<Counted>> countedSub;
+    EXPECT_TRUE(model.publisher().subscribe(countedSub, &Subscriber<Counted>::notifyEmpty));
+    resetCounts();
+
+    EXPECT_CALL(countedSub, notifyEmpty()).Times(2);
+    model.set(Counted{2});
+    model.setInternal(Counted{3});
+    model.publishPendingChanges();
+    EXPECT_EQ(0, Counted::copyCount);
+
+    // Only asking to detect reverts copies the published value
+    model.keepPublishedValue();
+    model.setInternal(Counted{4});
+    model.setInternal(Counted{3});
+    model.publishPendingChanges();
+    EXPECT_EQ(1, Counted::copyCount);
+
+    EXPECT_TRUE(model.publisher().unsubscribe(countedSub));
+}
+
 } // namespace Data
@@ -2,9 +2,13 @@
 #include "data/HeterogeneousQueue.hpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <array>
 #include <atomic>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 using namespace testing;
 
@@ -64,6 +68,267 @@ TEST(HeterogeneousQueue, IntQueueMultipleThreads)
     producer.join();
 }
 
+TEST(HeterogeneousQueue, NonBlockingIntQueue)
+{
+    HeterogeneousQueue<int> queue(64);
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.enqueue(i);
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        const int* element = queue.tryDequeue();
+        ASSERT_NE(nullptr, element);
+        EXPECT_EQ(i, *element);
+    }
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+    EXPECT_TRUE(queue.isEmpty());
+
+    queue.enqueue(7);
+    EXPECT_EQ(7, queue.dequeue());
+}
+
+TEST(HeterogeneousQueue, TimedDequeueIntQueue)
+{
+    HeterogeneousQueue<int> queue(64);
+    EXPECT_EQ(nullptr, queue.dequeueFor(std::chrono::milliseconds(1)));
+    EXPECT_EQ(nullptr, queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(1)));
+
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.enqueue(42);
+        queue.enqueue(33);
+    });
+
+    const int* element = queue.dequeueFor(std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(42, *element);
+
+    element = queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(33, *element);
+
+    producer.join();
+}
+
+TEST(HeterogeneousQueue, ConsumeAllIntQueue)
+{
+    HeterogeneousQueue<int> queue(64);
+    EXPECT_EQ(0u, queue.consumeAll([](const int&) { FAIL() << "Visited empty queue"; }));
+
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.enqueue(i);
+        }
+
+        int expected = 0;
+        EXPECT_EQ(100u, queue.consumeAll([&expected](const int& element) { EXPECT_EQ(expected++, element); }));
+        EXPECT_EQ(100, expected);
+        EXPECT_TRUE(queue.isEmpty());
+    }
+}
+
+TEST(HeterogeneousQueue, ThrowingVisitorIntQueue)
+{
+    HeterogeneousQueue<int> queue(64);
+
+    // Let the queue grow to its working size
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            queue.enqueue(i);
+        }
+        EXPECT_EQ(10u, queue.consumeAll([](const int&) {}));
+    }
+    const size_t blockCount = queue.getAllocatedBlockCount();
+
+    for (int round = 0; round < 10; ++round)
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            queue.enqueue(i);
+        }
+
+        std::vector<int> visited;
+        const auto throwOnFour = [&visited](const int& element) {
+            visited.push_back(element);
+            if (element == 4)
+                throw std::runtime_error("visit failed");
+        };
+        EXPECT_THROW(queue.dequeueBatch(8, throwOnFour), std::runtime_error);
+        EXPECT_THAT(visited, ElementsAre(0, 1, 2, 3, 4));
+
+        // The element thrown on is gone, the rest are still there
+        visited.clear();
+        EXPECT_EQ(5u, queue.consumeAll([&visited](const int& element) { visited.push_back(element); }));
+        EXPECT_THAT(visited, ElementsAre(5, 6, 7, 8, 9));
+        EXPECT_TRUE(queue.isEmpty());
+    }
+
+    // Space of the consumed elements was released, so the queue did not keep growing
+    EXPECT_EQ(blockCount, queue.getAllocatedBlockCount());
+}
+
+TEST(HeterogeneousQueue, DequeueBatchZeroIntQueue)
+{
+    HeterogeneousQueue<int> queue(64);
+    EXPECT_EQ(0u, queue.dequeueBatch(0, [](const int&) { FAIL() << "Visited with zero count"; }));
+
+    queue.enqueue(1);
+    EXPECT_EQ(0u, queue.dequeueBatch(0, [](const int&) { FAIL() << "Visited with zero count"; }));
+    EXPECT_FALSE(queue.isEmpty());
+    EXPECT_EQ(1, queue.dequeue());
+}
+
+TEST(HeterogeneousQueue, CompactIntQueue)
+{
+    // Small elements take a fraction of a cache line
+    HeterogeneousQueue<int> queue(256);
+    for (int i = 0; i < 8; ++i)
+    {
+        queue.enqueue(i);
+    }
+    EXPECT_EQ(1u, queue.getAllocatedBlockCount());
+
+    for (int i = 0; i < 8; ++i)
+    {
+        EXPECT_EQ(i, queue.dequeue());
+    }
+}
+
+TEST(HeterogeneousQueue, BlockTooBigForEnvelopeHeader)
+{
+    // Padding envelopes can take a whole block, so no block can be bigger than the header describes
+    EXPECT_THROW(HeterogeneousQueue<int>(HeterogeneousQueue<int>::MAX_BLOCK_SIZE + 1), std::length_error);
+}
+
+namespace {
+
+struct alignas(64) OverAlignedElement
+{
+    OverAlignedElement(int value) : value_(value) {}
+    int value_;
+};
+
+} // anonymous namespace
+
+TEST(HeterogeneousQueue, OverAlignedElementQueue)
+{
+    HeterogeneousQueue<OverAlignedElement> queue(256);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.enqueue(OverAlignedElement(i));
+        queue.enqueue(OverAlignedElement(-i));
+
+        for (int expected : {i, -i})
+        {
+            const OverAlignedElement& element = queue.dequeue();
+            EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(&element) % alignof(OverAlignedElement));
+            EXPECT_EQ(expected, element.value_);
+        }
+    }
+}
+
+TEST(HeterogeneousQueue, BlockPoolIntQueue)
+{
+    HeterogeneousQueue<int> queue(64, BlockPoolSettings{8, 2});
+    EXPECT_EQ(1u, queue.getAllocatedBlockCount());
+    EXPECT_EQ(0u, queue.getReusedBlockCount());
+
+    const auto burst = [&queue] {
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.enqueue(i);
+        }
+        for (int i = 0; i < 100; ++i)
+        {
+            ASSERT_EQ(i, queue.dequeue());
+        }
+    };
+    const auto trickle = [&queue] {
+        for (int i = 0; i < 1000; ++i)
+        {
+            queue.enqueue(i);
+            ASSERT_EQ(i, queue.dequeue());
+        }
+    };
+
+    burst();
+    trickle();
+    const size_t allocatedBlockCount = queue.getAllocatedBlockCount();
+    EXPECT_LT(1u, allocatedBlockCount);
+
+    // Shrunk while idle, grows back with pooled blocks
+    for (int round = 0; round < 5; ++round)
+    {
+        burst();
+        trickle();
+    }
+    EXPECT_EQ(allocatedBlockCount, queue.getAllocatedBlockCount());
+    EXPECT_LT(0u, queue.getReusedBlockCount());
+}
+
+TEST(HeterogeneousQueue, BlockPoolIntQueueMultipleThreads)
+{
+    HeterogeneousQueue<int> queue(64, BlockPoolSettings{4, 1});
+    static const int count = 100000;
+
+    std::thread consumer([&queue] {
+        for (int i = 0; i < count; ++i)
+        {
+            ASSERT_EQ(i, queue.dequeue());
+        }
+    });
+
+    for (int i = 0; i < count; ++i)
+    {
+        queue.enqueue(i);
+        if (i % 1000 == 0)
+            std::this_thread::yield();
+    }
+
+    consumer.join();
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(HeterogeneousQueue, DequeueBatchIntQueueMultipleThreads)
+{
+    using Queue = HeterogeneousQueue<int>;
+    const size_t count = 10000;
+
+    Queue queue(128);
+
+    std::thread producer([&queue, count] {
+        int lastSent = 0;
+        for (size_t c = 0; c < count; ++c)
+        {
+            queue.enqueue(++lastSent);
+        }
+    });
+
+    int lastReceived = 0;
+    size_t received = 0;
+    while (received < count)
+    {
+        const size_t batch = queue.dequeueBatch(16, [&lastReceived](const int& element) {
+            ASSERT_EQ(++lastReceived, element);
+        });
+        EXPECT_LE(1u, batch);
+        EXPECT_GE(16u, batch);
+        received += batch;
+    }
+    EXPECT_EQ(count, received);
+
+    producer.join();
+}
+
 namespace {
 
 enum ElementId
@@ -126,6 +391,16 @@ private:
 using IntElement = Element<INT_ELEMENT, int>;
 using DoubleElement = Element<DOUBLE_ELEMENT, double>;
 using StringElement = Element<STRING_ELEMENT, std::string>;
+using BigElement = Element<EMPTY_ELEMENT, std::array<char, 4000>>;
+
+/** Element whose construction fails */
+class ThrowingElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = EMPTY_ELEMENT;
+    explicit ThrowingElement(int) { throw std::runtime_error("construction failed"); }
+    ElementId getId() const override { return ID_T; }
+};
 
 template <typename T>
 const T& element_cast(const ElementIf& element)
@@ -167,4 +442,97 @@ TEST(HeterogeneousQueue, ElementQueue)
     EXPECT_EQ(0, elementCounterS);
 }
 
+TEST(HeterogeneousQueue, ElementQueueEmplace)
+{
+    elementCounterS = 0;
+    {
+        HeterogeneousQueue<ElementIf> queue(64);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.emplace<StringElement>("Brown fox jumps over the lazy dog and does this and that");
+            queue.emplace<DoubleElement>(3.1415);
+            queue.emplace<EmptyElement>();
+        }
+        EXPECT_EQ(300, elementCounterS);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            EXPECT_EQ(
+                std::string("Brown fox jumps over the lazy dog and does this and that"),
+                (element_cast<StringElement>(queue.dequeue())).data());
+            EXPECT_EQ(3.1415, (element_cast<DoubleElement>(queue.dequeue())).data());
+            EXPECT_EQ(EMPTY_ELEMENT, queue.dequeue().getId());
+        }
+        EXPECT_TRUE(queue.isEmpty());
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(HeterogeneousQueue, ElementQueueConsumeAll)
+{
+    elementCounterS = 0;
+    {
+        HeterogeneousQueue<ElementIf> queue(256);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.enqueue(EmptyElement());
+            queue.enqueue(DoubleElement(3.1415));
+            queue.enqueue(StringElement("Brown fox jumps over the lazy dog and does this and that"));
+
+            std::vector<ElementId> ids;
+            EXPECT_EQ(3u, queue.consumeAll([&ids](const ElementIf& element) { ids.push_back(element.getId()); }));
+            EXPECT_THAT(ids, ElementsAre(EMPTY_ELEMENT, DOUBLE_ELEMENT, STRING_ELEMENT));
+            EXPECT_EQ(0, elementCounterS);
+        }
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(HeterogeneousQueue, ElementQueueElementBiggerThanGrownBlock)
+{
+    elementCounterS = 0;
+    {
+        HeterogeneousQueue<ElementIf> queue(256);
+
+        for (int i = 0; i < 10; ++i)
+        {
+            queue.emplace<IntElement>(i);
+            queue.emplace<BigElement>();
+            queue.emplace<IntElement>(-i);
+
+            EXPECT_EQ(i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_EQ(EMPTY_ELEMENT, queue.dequeue().getId());
+            EXPECT_EQ(-i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_TRUE(queue.isEmpty());
+        }
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(HeterogeneousQueue, ElementQueueThrowingConstructor)
+{
+    elementCounterS = 0;
+    {
+        HeterogeneousQueue<ElementIf> queue(256, BlockPoolSettings{2, 1});
+
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.emplace<IntElement>(i);
+            EXPECT_THROW(queue.emplace<ThrowingElement>(i), std::runtime_error);
+            queue.emplace<IntElement>(-i);
+
+            EXPECT_EQ(i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_EQ(-i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_TRUE(queue.isEmpty());
+        }
+
+        // Failed elements took no space, so the first block was enough
+        EXPECT_EQ(1u, queue.getAllocatedBlockCount());
+        EXPECT_EQ(0u, queue.getReusedBlockCount());
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
 } // namespace Data
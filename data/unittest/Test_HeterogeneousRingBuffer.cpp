@@ -2,6 +2,9 @@
 #include "data/HeterogeneousRingBuffer.hpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
 
@@ -64,6 +67,207 @@ TEST(HeterogeneousRingBuffer, IntRingBufferMultipleThreads)
     producer.join();
 }
 
+TEST(HeterogeneousRingBuffer, LockFreeIntRingBuffer)
+{
+    HeterogeneousRingBuffer<int, 112, LockFreeSync> queue;
+    EXPECT_TRUE(queue.isEmpty());
+
+    queue.enqueue(42);
+    EXPECT_FALSE(queue.isEmpty());
+
+    queue.enqueue(33);
+    EXPECT_EQ(42, queue.dequeue());
+
+    queue.enqueue(99);
+    EXPECT_EQ(33, queue.dequeue());
+    EXPECT_EQ(99, queue.dequeue());
+
+    queue.enqueue(5);
+    EXPECT_EQ(5, queue.dequeue());
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(HeterogeneousRingBuffer, LockFreeIntRingBufferMultipleThreads)
+{
+    using Queue = HeterogeneousRingBuffer<int, 4 * 24, LockFreeSync>;
+
+    struct Context
+    {
+        static void produce(Queue& queue, size_t count)
+        {
+            int lastSent = 0;
+            for (size_t c = 0; c < count; ++c)
+            {
+                queue.enqueue(++lastSent);
+            }
+        }
+
+        static void consume(Queue& queue, size_t count)
+        {
+            int lastReceived = 0;
+            for (size_t c = 0; c < count; ++c)
+            {
+                ASSERT_EQ(++lastReceived, queue.dequeue());
+            }
+        }
+    };
+
+    Queue queue;
+
+    std::thread consumer(&Context::consume, std::ref(queue), 100000);
+    std::thread producer(&Context::produce, std::ref(queue), 100000);
+
+    consumer.join();
+    producer.join();
+}
+
+TEST(HeterogeneousRingBuffer, PackedLayoutIntRingBuffer)
+{
+    using Packed = HeterogeneousRingBuffer<int, 112, SemaphoreSync, PackedLayout>;
+    EXPECT_LT(sizeof(Packed), sizeof(HeterogeneousRingBuffer<int, 112, SemaphoreSync>));
+
+    Packed queue;
+    queue.enqueue(42);
+    queue.enqueue(33);
+    EXPECT_EQ(42, queue.dequeue());
+
+    queue.enqueue(99);
+    EXPECT_EQ(33, queue.dequeue());
+    EXPECT_EQ(99, queue.dequeue());
+    EXPECT_TRUE(queue.isEmpty());
+}
+
+template <typename Sync>
+void testNonBlockingIntRingBuffer()
+{
+    HeterogeneousRingBuffer<int, 112, Sync> queue;
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+
+    // Fill the buffer
+    int count = 0;
+    while (queue.tryEnqueue(count))
+    {
+        ++count;
+    }
+    EXPECT_LT(0, count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int* element = queue.tryDequeue();
+        ASSERT_NE(nullptr, element);
+        EXPECT_EQ(i, *element);
+    }
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+    EXPECT_TRUE(queue.isEmpty());
+
+    // Failed dequeue does not release anything extra
+    EXPECT_TRUE(queue.tryEnqueue(7));
+    EXPECT_EQ(7, queue.dequeue());
+}
+
+template <typename Sync>
+void testTimedDequeueIntRingBuffer()
+{
+    HeterogeneousRingBuffer<int, 112, Sync> queue;
+    EXPECT_EQ(nullptr, queue.dequeueFor(std::chrono::milliseconds(1)));
+    EXPECT_EQ(nullptr, queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::milliseconds(1)));
+
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.enqueue(42);
+        queue.enqueue(33);
+    });
+
+    const int* element = queue.dequeueFor(std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(42, *element);
+
+    element = queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(33, *element);
+
+    producer.join();
+}
+
+TEST(HeterogeneousRingBuffer, NonBlockingIntRingBuffer)
+{
+    testNonBlockingIntRingBuffer<SemaphoreSync>();
+    testNonBlockingIntRingBuffer<LockFreeSync>();
+}
+
+TEST(HeterogeneousRingBuffer, TimedDequeueIntRingBuffer)
+{
+    testTimedDequeueIntRingBuffer<SemaphoreSync>();
+    testTimedDequeueIntRingBuffer<LockFreeSync>();
+}
+
+template <typename Sync>
+void testReserveCommitRingBuffer()
+{
+    HeterogeneousRingBuffer<int, 256, Sync> queue;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        const std::string text = "bytes " + std::to_string(i);
+
+        // Reserve more than is used, rest goes back to the buffer
+        auto writable = queue.reserve(32);
+        ASSERT_EQ(32u, writable.size_);
+        std::memcpy(writable.data_, text.data(), text.size());
+        queue.commit(text.size());
+        queue.enqueue(i);
+
+        auto readable = queue.peek();
+        EXPECT_EQ(text, std::string(reinterpret_cast<const char*>(readable.data_), readable.size_));
+        queue.release();
+        EXPECT_EQ(i, queue.dequeue());
+        EXPECT_TRUE(queue.isEmpty());
+    }
+}
+
+template <typename Sync>
+void testReserveCommitRingBufferMultipleThreads()
+{
+    HeterogeneousRingBuffer<int, 256, Sync> queue;
+    static const int count = 10000;
+
+    std::thread producer([&queue] {
+        for (int i = 0; i < count; ++i)
+        {
+            const size_t size = 1 + static_cast<size_t>(i % 64);
+            auto writable = queue.reserve(size);
+            std::memset(writable.data_, i % 256, size);
+            queue.commit(size);
+        }
+    });
+
+    for (int i = 0; i < count; ++i)
+    {
+        auto readable = queue.peek();
+        ASSERT_EQ(1 + static_cast<size_t>(i % 64), readable.size_);
+        for (size_t b = 0; b < readable.size_; ++b)
+        {
+            ASSERT_EQ(i % 256, readable.data_[b]);
+        }
+        queue.release();
+    }
+    EXPECT_TRUE(queue.isEmpty());
+
+    producer.join();
+}
+
+TEST(HeterogeneousRingBuffer, ReserveCommitRingBuffer)
+{
+    testReserveCommitRingBuffer<SemaphoreSync>();
+    testReserveCommitRingBuffer<LockFreeSync>();
+}
+
+TEST(HeterogeneousRingBuffer, ReserveCommitRingBufferMultipleThreads)
+{
+    testReserveCommitRingBufferMultipleThreads<SemaphoreSync>();
+    testReserveCommitRingBufferMultipleThreads<LockFreeSync>();
+}
+
 namespace {
 
 enum ElementId
@@ -137,4 +341,181 @@ TEST(HeterogeneousRingBuffer, ElementRingBuffer)
     }
 }
 
+TEST(HeterogeneousRingBuffer, LockFreeElementRingBuffer)
+{
+    HeterogeneousRingBuffer<ElementIf, 256, LockFreeSync> queue;
+    EXPECT_TRUE(queue.isEmpty());
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        queue.enqueue(EmptyElement());
+        queue.enqueue(DoubleElement(3.1415));
+        queue.enqueue(StringElement("Brown fox jumps over the lazy dog and does this and that"));
+
+        EXPECT_EQ(EMPTY_ELEMENT, queue.dequeue().getId());
+        EXPECT_EQ(3.1415, (element_cast<DoubleElement>(queue.dequeue())).data());
+        EXPECT_EQ(
+            std::string("Brown fox jumps over the lazy dog and does this and that"),
+            (element_cast<StringElement>(queue.dequeue())).data());
+        EXPECT_TRUE(queue.isEmpty());
+    }
+}
+
+namespace {
+
+/** Element which can be neither copied nor moved, only constructed in place */
+class PinnedElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = STRING_ELEMENT;
+    PinnedElement(const char* prefix, int number) : data_{std::string(prefix) + std::to_string(number)} {}
+    PinnedElement(const PinnedElement&) = delete;
+    PinnedElement(PinnedElement&&) = delete;
+    ElementId getId() const override { return ID_T; }
+    const std::string& data() const { return data_; }
+
+private:
+    std::string data_;
+};
+
+/** Element which can only be moved */
+class MoveOnlyElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = INT_ELEMENT;
+    explicit MoveOnlyElement(int data) : data_{std::make_unique<int>(data)} {}
+    MoveOnlyElement(MoveOnlyElement&&) = default;
+    ElementId getId() const override { return ID_T; }
+    int data() const { return *data_; }
+
+private:
+    std::unique_ptr<int> data_;
+};
+
+/** Element counting its live instances */
+class CountedElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = INT_ELEMENT;
+    explicit CountedElement(int& liveCount) : liveCount_{liveCount} { ++liveCount_; }
+    CountedElement(const CountedElement& other) : ElementIf(other), liveCount_{other.liveCount_} { ++liveCount_; }
+    ~CountedElement() override { --liveCount_; }
+    ElementId getId() const override { return ID_T; }
+
+private:
+    int& liveCount_;
+};
+
+/** Element whose construction fails, bigger than the others to make it wrap at different positions */
+class ThrowingElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = EMPTY_ELEMENT;
+    explicit ThrowingElement(int) { throw std::runtime_error("construction failed"); }
+    ElementId getId() const override { return ID_T; }
+    const char* data() const { return data_; }
+
+private:
+    char data_[40];
+};
+
+} // anonymous namespace
+
+TEST(HeterogeneousRingBuffer, EmplaceElementRingBuffer)
+{
+    HeterogeneousRingBuffer<ElementIf, 256> queue;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.emplace<PinnedElement>("element ", i);
+        queue.emplace<DoubleElement>(3.1415);
+        queue.enqueue(MoveOnlyElement(i));
+
+        EXPECT_EQ("element " + std::to_string(i), (element_cast<PinnedElement>(queue.dequeue())).data());
+        EXPECT_EQ(3.1415, (element_cast<DoubleElement>(queue.dequeue())).data());
+        EXPECT_EQ(i, (element_cast<MoveOnlyElement>(queue.dequeue())).data());
+        EXPECT_TRUE(queue.isEmpty());
+    }
+}
+
+template <typename Sync>
+void testDestroyElementsRingBuffer()
+{
+    int liveCount = 0;
+    {
+        HeterogeneousRingBuffer<ElementIf, 256, Sync> queue;
+
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.template emplace<CountedElement>(liveCount);
+            queue.enqueue(CountedElement(liveCount));
+            EXPECT_EQ(2, liveCount);
+
+            (void)queue.dequeue();
+            EXPECT_EQ(2, liveCount); // Held until next dequeue
+            (void)queue.dequeue();
+            EXPECT_EQ(1, liveCount);
+            queue.release();
+            EXPECT_EQ(0, liveCount);
+        }
+
+        // Left in the buffer, one of them held
+        queue.template emplace<CountedElement>(liveCount);
+        queue.template emplace<CountedElement>(liveCount);
+        queue.template emplace<CountedElement>(liveCount);
+        (void)queue.dequeue();
+        EXPECT_EQ(3, liveCount);
+    }
+    EXPECT_EQ(0, liveCount);
+}
+
+TEST(HeterogeneousRingBuffer, DestroyElementsRingBuffer)
+{
+    testDestroyElementsRingBuffer<SemaphoreSync>();
+    testDestroyElementsRingBuffer<LockFreeSync>();
+}
+
+template <typename Sync>
+size_t fillRingBuffer(HeterogeneousRingBuffer<ElementIf, 256, Sync>& queue)
+{
+    size_t count = 0;
+    while (queue.tryEnqueue(IntElement(0)))
+    {
+        ++count;
+    }
+
+    while (queue.tryDequeue())
+    {
+    }
+    return count;
+}
+
+template <typename Sync>
+void testThrowingElementRingBuffer()
+{
+    HeterogeneousRingBuffer<ElementIf, 256, Sync> queue;
+    const size_t capacity = fillRingBuffer(queue);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.enqueue(IntElement(i));
+        EXPECT_THROW(queue.template emplace<ThrowingElement>(i), std::runtime_error);
+        EXPECT_TRUE(queue.tryEnqueue(IntElement(-i)));
+
+        EXPECT_EQ(i, element_cast<IntElement>(queue.dequeue()).data());
+        EXPECT_EQ(-i, element_cast<IntElement>(queue.dequeue()).data());
+        EXPECT_EQ(nullptr, queue.tryDequeue());
+        EXPECT_TRUE(queue.isEmpty());
+    }
+
+    // No space lost, apart from padding depending on where the buffer was left
+    EXPECT_LE(capacity - 1, fillRingBuffer(queue));
+}
+
+TEST(HeterogeneousRingBuffer, ThrowingElementRingBuffer)
+{
+    testThrowingElementRingBuffer<SemaphoreSync>();
+    testThrowingElementRingBuffer<LockFreeSync>();
+}
+
 } // namespace Data
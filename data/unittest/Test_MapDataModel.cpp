@@ -0,0 +1,261 @@
+#include "data/AsyncSubscriber.hpp"
+#include "data/MapDataModel.hpp"
+#include "data/ModelBatch.hpp"
+#include "test_util/ManualExecutor.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Data {
+
+namespace {
+
+using Map = std::map<int, std::string>;
+using Model = MapDataModel<Map>;
+
+/** Subscriber recording the deltas and full values */
+class Observer
+{
+public:
+    struct Seen
+    {
+        Map value_;
+        std::vector<int> inserted_;
+        std::vector<int> updated_;
+        std::vector<int> erased_;
+    };
+
+    void notifyDelta(const Model::Delta& delta)
+    {
+        deltas_.push_back(Seen{delta.value(), delta.inserted_, delta.updated_, delta.erased_});
+    }
+    void notifyValue(const Map& value) { values_.push_back(value); }
+
+    std::vector<Seen> deltas_;
+    std::vector<Map> values_;
+};
+
+/** Map counting its copies */
+class CountingMap : public Map
+{
+public:
+    using Map::Map;
+
+    CountingMap() = default;
+    CountingMap(const CountingMap& other) : Map(other) { ++copies_; }
+    CountingMap(CountingMap&&) = default;
+    CountingMap& operator=(const CountingMap& other)
+    {
+        ++copies_;
+        Map::operator=(other);
+        return *this;
+    }
+    CountingMap& operator=(CountingMap&&) = default;
+
+    static int copies_;
+};
+
+int CountingMap::copies_ = 0;
+
+} // anonymous namespace
+
+class MapDataModelTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        EXPECT_TRUE(model.deltaPublisher().subscribe(observer, &Observer::notifyDelta));
+        EXPECT_TRUE(model.publisher().subscribe(observer, &Observer::notifyValue));
+    }
+
+    void TearDown() override
+    {
+        EXPECT_TRUE(model.deltaPublisher().unsubscribe(observer));
+        EXPECT_TRUE(model.publisher().unsubscribe(observer));
+    }
+
+    Model model{Map{{1, "a"}, {2, "b"}}};
+    Observer observer;
+};
+
+TEST_F(MapDataModelTest, InsertOrAssign)
+{
+    model.insertOrAssign(3, "c");
+    model.insertOrAssign(1, "A");
+    model.insertOrAssign(2, "b"); // Unchanged
+
+    ASSERT_EQ(2u, observer.deltas_.size());
+    EXPECT_EQ(std::vector<int>{3}, observer.deltas_[0].inserted_);
+    EXPECT_TRUE(observer.deltas_[0].updated_.empty());
+    EXPECT_EQ(std::vector<int>{1}, observer.deltas_[1].updated_);
+    EXPECT_TRUE(observer.deltas_[1].inserted_.empty());
+    EXPECT_EQ((Map{{1, "A"}, {2, "b"}, {3, "c"}}), observer.deltas_[1].value_);
+
+    ASSERT_EQ(2u, observer.values_.size());
+    EXPECT_EQ(model.get(), observer.values_[1]);
+}
+
+TEST_F(MapDataModelTest, Erase)
+{
+    model.erase(1);
+    model.erase(5); // Not there
+
+    ASSERT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ(std::vector<int>{1}, observer.deltas_[0].erased_);
+    EXPECT_EQ((Map{{2, "b"}}), model.get());
+}
+
+TEST_F(MapDataModelTest, SetPublishesDifferences)
+{
+    model.set(Map{{0, "z"}, {2, "B"}, {4, "d"}});
+
+    ASSERT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ((std::vector<int>{0, 4}), observer.deltas_[0].inserted_);
+    EXPECT_EQ(std::vector<int>{2}, observer.deltas_[0].updated_);
+    EXPECT_EQ(std::vector<int>{1}, observer.deltas_[0].erased_);
+    EXPECT_EQ((Map{{0, "z"}, {2, "B"}, {4, "d"}}), observer.values_.at(0));
+
+    // Same value, nothing published
+    model.set(Map{{0, "z"}, {2, "B"}, {4, "d"}});
+    EXPECT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ(1u, observer.values_.size());
+}
+
+TEST_F(MapDataModelTest, PendingChangesCombine)
+{
+    model.insertOrAssignInternal(3, "c");
+    model.eraseInternal(3); // Inserted and erased, not reported
+    model.eraseInternal(1);
+    model.insertOrAssignInternal(1, "A"); // Erased and inserted, an update
+    model.insertOrAssignInternal(2, "B");
+    model.eraseInternal(2); // Updated and erased, an erasure
+    model.insertOrAssignInternal(4, "d");
+    model.insertOrAssignInternal(4, "D"); // Inserted and updated, an insertion
+    EXPECT_TRUE(observer.deltas_.empty());
+
+    model.publishPendingChanges();
+
+    ASSERT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ(std::vector<int>{4}, observer.deltas_[0].inserted_);
+    EXPECT_EQ(std::vector<int>{1}, observer.deltas_[0].updated_);
+    EXPECT_EQ(std::vector<int>{2}, observer.deltas_[0].erased_);
+    EXPECT_EQ((Map{{1, "A"}, {4, "D"}}), observer.deltas_[0].value_);
+
+    // Nothing left to publish
+    model.publishPendingChanges();
+    EXPECT_EQ(1u, observer.deltas_.size());
+}
+
+TEST_F(MapDataModelTest, ModelBatch)
+{
+    {
+        ModelBatch batch;
+        batch.set(model, Map{{1, "a"}, {2, "B"}});
+        batch.set(model, Map{{2, "B"}, {3, "c"}});
+        EXPECT_TRUE(observer.deltas_.empty());
+    }
+
+    ASSERT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ(std::vector<int>{3}, observer.deltas_[0].inserted_);
+    EXPECT_EQ(std::vector<int>{2}, observer.deltas_[0].updated_);
+    EXPECT_EQ(std::vector<int>{1}, observer.deltas_[0].erased_);
+}
+
+TEST(MapDataModel, CustomOrder)
+{
+    MapDataModel<std::map<int, int, std::greater<int>>> model;
+    std::vector<int> inserted;
+    struct Collector
+    {
+        void notify(const MapDataModel<std::map<int, int, std::greater<int>>>::Delta& delta)
+        {
+            inserted_->insert(inserted_->end(), delta.inserted_.begin(), delta.inserted_.end());
+        }
+        std::vector<int>* inserted_;
+    } collector{&inserted};
+    EXPECT_TRUE(model.deltaPublisher().subscribe(collector, &Collector::notify));
+
+    model.set({{1, 1}, {3, 3}, {2, 2}});
+    EXPECT_EQ((std::vector<int>{3, 2, 1}), inserted);
+
+    EXPECT_TRUE(model.deltaPublisher().unsubscribe(collector));
+}
+
+TEST(MapDataModel, AsyncLatestDelta)
+{
+    Model model(Map{{1, "a"}});
+    Observer observer;
+    ManualExecutor executor;
+    using Callback = AsyncSubscriber<Model::Delta>::Callback;
+    AsyncSubscriber<Model::Delta> subscription(
+        model.deltaPublisher(), executor, Callback::fromMember(observer, &Observer::notifyDelta), Delivery::Latest);
+
+    model.insertOrAssign(2, "b");
+    model.erase(1);
+    model.insertOrAssign(3, "c");
+    model.erase(3); // Inserted and erased while pending, not reported
+    executor.runAll();
+
+    // The coalesced deltas are merged
+    ASSERT_EQ(1u, observer.deltas_.size());
+    EXPECT_EQ((Map{{2, "b"}}), observer.deltas_[0].value_);
+    EXPECT_EQ(std::vector<int>({2}), observer.deltas_[0].inserted_);
+    EXPECT_TRUE(observer.deltas_[0].updated_.empty());
+    EXPECT_EQ(std::vector<int>({1}), observer.deltas_[0].erased_);
+}
+
+TEST(MapDataModel, AsyncDeltaKeepsItsValue)
+{
+    Model model(Map{{1, "a"}});
+    Observer observer;
+    ManualExecutor executor;
+    using Callback = AsyncSubscriber<Model::Delta>::Callback;
+    AsyncSubscriber<Model::Delta> subscription(
+        model.deltaPublisher(), executor, Callback::fromMember(observer, &Observer::notifyDelta), Delivery::Every);
+
+    model.insertOrAssign(1, "A");
+    model.insertOrAssign(2, "b");
+    executor.runAll();
+
+    // Each delivered delta has the value it was published with
+    ASSERT_EQ(2u, observer.deltas_.size());
+    EXPECT_EQ((Map{{1, "A"}}), observer.deltas_[0].value_);
+    EXPECT_EQ(std::vector<int>({1}), observer.deltas_[0].updated_);
+    EXPECT_EQ((Map{{1, "A"}, {2, "b"}}), observer.deltas_[1].value_);
+    EXPECT_EQ(std::vector<int>({2}), observer.deltas_[1].inserted_);
+}
+
+TEST(MapDataModel, AsyncDeltaCopiesMapOncePerPublication)
+{
+    using CountingModel = MapDataModel<CountingMap>;
+    struct Collector
+    {
+        void notify(const CountingModel::Delta& delta) { values_.push_back(delta.value()); }
+        std::vector<Map> values_;
+    };
+
+    CountingModel model(CountingMap{{1, "a"}});
+    Collector first;
+    Collector second;
+    ManualExecutor executor;
+    using Callback = AsyncSubscriber<CountingModel::Delta>::Callback;
+    AsyncSubscriber<CountingModel::Delta> firstSubscription(
+        model.deltaPublisher(), executor, Callback::fromMember(first, &Collector::notify), Delivery::Latest);
+    AsyncSubscriber<CountingModel::Delta> secondSubscription(
+        model.deltaPublisher(), executor, Callback::fromMember(second, &Collector::notify), Delivery::Latest);
+
+    CountingMap::copies_ = 0;
+    model.insertOrAssign(2, "b");
+    model.insertOrAssign(3, "c");
+    model.erase(1);
+    executor.runAll();
+
+    // One snapshot per publication, shared by both subscribers and by the coalesced deltas
+    EXPECT_EQ(3, CountingMap::copies_);
+    EXPECT_EQ((std::vector<Map>{Map{{2, "b"}, {3, "c"}}}), first.values_);
+    EXPECT_EQ((std::vector<Map>{Map{{2, "b"}, {3, "c"}}}), second.values_);
+}
+
+} // namespace Data
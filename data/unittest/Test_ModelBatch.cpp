@@ -0,0 +1,181 @@
+#include "data/DataModel.hpp"
+#include "data/ModelBatch.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace Data {
+
+namespace {
+
+/** Subscriber recording the values of both models when either is notified */
+class Observer
+{
+public:
+    Observer(DataModel<int>& first, DataModel<std::string>& second) : first_(first), second_(second) {}
+
+    void notifyFirst() { seen_.emplace_back("first", first_.get(), second_.get()); }
+    void notifySecond() { seen_.emplace_back("second", first_.get(), second_.get()); }
+
+    DataModel<int>& first_;
+    DataModel<std::string>& second_;
+    std::vector<std::tuple<std::string, int, std::string>> seen_;
+};
+
+/** Subscriber throwing on notification */
+struct Thrower
+{
+    void notify() { throw std::runtime_error("subscriber failed"); }
+};
+
+} // anonymous namespace
+
+TEST(ModelBatch, PublishOnceAtCommit)
+{
+    DataModel<int> first(0);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    EXPECT_TRUE(first.publisher().subscribe(observer, &Observer::notifyFirst));
+    EXPECT_TRUE(second.publisher().subscribe(observer, &Observer::notifySecond));
+
+    ModelBatch batch;
+    batch.set(first, 1);
+    batch.set(second, std::string("a"));
+    batch.set(first, 2);
+    EXPECT_TRUE(observer.seen_.empty());
+
+    batch.commit();
+
+    using Seen = std::tuple<std::string, int, std::string>;
+    EXPECT_EQ(std::vector<Seen>({Seen{"first", 2, "a"}, Seen{"second", 2, "a"}}), observer.seen_);
+
+    // Nothing left to publish
+    batch.commit();
+    EXPECT_EQ(2u, observer.seen_.size());
+
+    EXPECT_TRUE(first.publisher().unsubscribe(observer));
+    EXPECT_TRUE(second.publisher().unsubscribe(observer));
+}
+
+TEST(ModelBatch, CommitOnDestruction)
+{
+    DataModel<int> first(0);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    EXPECT_TRUE(first.publisher().subscribe(observer, &Observer::notifyFirst));
+
+    {
+        ModelBatch batch;
+        batch.set(first, 5);
+        batch.set(first, 0); // Back to the original, nothing to publish
+    }
+    EXPECT_TRUE(observer.seen_.empty());
+
+    {
+        ModelBatch batch;
+        batch.set(first, 5);
+        batch.set(first, 6);
+    }
+
+    ASSERT_EQ(1u, observer.seen_.size());
+    EXPECT_EQ(6, std::get<1>(observer.seen_.front()));
+
+    EXPECT_TRUE(first.publisher().unsubscribe(observer));
+}
+
+TEST(ModelBatch, UnchangedValueIsNotPublished)
+{
+    DataModel<int> first(7);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    EXPECT_TRUE(first.publisher().subscribe(observer, &Observer::notifyFirst));
+
+    {
+        ModelBatch batch;
+        batch.set(first, 7);
+    }
+
+    EXPECT_TRUE(observer.seen_.empty());
+    EXPECT_TRUE(first.publisher().unsubscribe(observer));
+}
+
+TEST(ModelBatch, NoPublishWhenUnwinding)
+{
+    DataModel<int> first(0);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    EXPECT_TRUE(first.publisher().subscribe(observer, &Observer::notifyFirst));
+
+    try
+    {
+        ModelBatch batch;
+        batch.set(first, 5);
+        throw std::runtime_error("failed halfway");
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    // Set but not published
+    EXPECT_TRUE(observer.seen_.empty());
+    EXPECT_EQ(5, first.get());
+
+    first.publishPendingChanges();
+    ASSERT_EQ(1u, observer.seen_.size());
+    EXPECT_EQ(5, std::get<1>(observer.seen_.front()));
+
+    EXPECT_TRUE(first.publisher().unsubscribe(observer));
+}
+
+TEST(ModelBatch, ThrowingSubscriberKeepsRestPending)
+{
+    DataModel<int> first(0);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    Thrower thrower;
+    EXPECT_TRUE(first.publisher().subscribe(thrower, &Thrower::notify));
+    EXPECT_TRUE(second.publisher().subscribe(observer, &Observer::notifySecond));
+
+    ModelBatch batch;
+    batch.set(first, 1);
+    batch.set(second, std::string("a"));
+    EXPECT_THROW(batch.commit(), std::runtime_error);
+    EXPECT_TRUE(observer.seen_.empty());
+
+    // The model after the failed one is published on the next commit
+    batch.commit();
+    using Seen = std::tuple<std::string, int, std::string>;
+    EXPECT_EQ(std::vector<Seen>({Seen{"second", 1, "a"}}), observer.seen_);
+
+    EXPECT_TRUE(first.publisher().unsubscribe(thrower));
+    EXPECT_TRUE(second.publisher().unsubscribe(observer));
+}
+
+TEST(ModelBatch, ThrowingSubscriberOnDestruction)
+{
+    DataModel<int> first(0);
+    DataModel<std::string> second;
+    Observer observer(first, second);
+    Thrower thrower;
+    EXPECT_TRUE(first.publisher().subscribe(thrower, &Thrower::notify));
+    EXPECT_TRUE(second.publisher().subscribe(observer, &Observer::notifySecond));
+
+    {
+        ModelBatch batch;
+        batch.set(first, 1);
+        batch.set(second, std::string("a"));
+    } // Reported, not terminating
+
+    // The rest of the models are still published
+    using Seen = std::tuple<std::string, int, std::string>;
+    EXPECT_EQ(std::vector<Seen>({Seen{"second", 1, "a"}}), observer.seen_);
+
+    EXPECT_TRUE(first.publisher().unsubscribe(thrower));
+    EXPECT_TRUE(second.publisher().unsubscribe(observer));
+}
+
+} // namespace Data
@@ -0,0 +1,370 @@
+#include "test_util/LogHelpers.hpp"
+#include "data/MultiProducerHeterogeneousQueue.hpp"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace testing;
+
+namespace Data {
+
+TEST(MultiProducerHeterogeneousQueue, IntQueue)
+{
+    MultiProducerHeterogeneousQueue<int> queue(256);
+    EXPECT_TRUE(queue.isEmpty());
+
+    queue.enqueue(42);
+    EXPECT_FALSE(queue.isEmpty());
+
+    queue.enqueue(33);
+    EXPECT_EQ(42, queue.dequeue());
+
+    queue.enqueue(99);
+    EXPECT_EQ(33, queue.dequeue());
+    EXPECT_EQ(99, queue.dequeue());
+
+    queue.enqueue(5);
+    EXPECT_EQ(5, queue.dequeue());
+    EXPECT_TRUE(queue.isEmpty());
+    EXPECT_EQ(nullptr, queue.tryDequeue());
+}
+
+TEST(MultiProducerHeterogeneousQueue, IntQueueGrowAndReuse)
+{
+    MultiProducerHeterogeneousQueue<int> queue(128);
+
+    for (int round = 0; round < 100; ++round)
+    {
+        for (int i = 0; i < round; ++i)
+        {
+            queue.enqueue(i);
+        }
+
+        for (int i = 0; i < round; ++i)
+        {
+            const int* element = queue.tryDequeue();
+            ASSERT_NE(nullptr, element);
+            EXPECT_EQ(i, *element);
+        }
+        EXPECT_TRUE(queue.isEmpty());
+    }
+}
+
+TEST(MultiProducerHeterogeneousQueue, TimedDequeueIntQueue)
+{
+    MultiProducerHeterogeneousQueue<int> queue(128);
+    EXPECT_EQ(nullptr, queue.dequeueFor(std::chrono::milliseconds(1)));
+
+    std::thread producer([&queue] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        queue.enqueue(42);
+    });
+
+    const int* element = queue.dequeueUntil(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+    ASSERT_NE(nullptr, element);
+    EXPECT_EQ(42, *element);
+
+    producer.join();
+}
+
+TEST(MultiProducerHeterogeneousQueue, IntQueueMultipleProducers)
+{
+    using Queue = MultiProducerHeterogeneousQueue<std::pair<int, int>>;
+    const int producerCount = 8;
+    const int countPerProducer = 10000;
+
+    Queue queue(128);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, p, countPerProducer] {
+            for (int c = 0; c < countPerProducer; ++c)
+            {
+                queue.enqueue(std::make_pair(p, c));
+            }
+        });
+    }
+
+    // Each producer's elements must arrive in order
+    std::vector<int> lastReceived(producerCount, -1);
+    for (int c = 0; c < producerCount * countPerProducer; ++c)
+    {
+        const std::pair<int, int>& element = queue.dequeue();
+        ASSERT_EQ(++lastReceived[element.first], element.second);
+    }
+    EXPECT_TRUE(queue.isEmpty());
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+}
+
+namespace {
+
+struct alignas(64) OverAlignedElement
+{
+    OverAlignedElement(int value) : value_(value) {}
+    int value_;
+};
+
+} // anonymous namespace
+
+TEST(MultiProducerHeterogeneousQueue, OverAlignedElementQueue)
+{
+    MultiProducerHeterogeneousQueue<OverAlignedElement> queue(256);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        queue.enqueue(OverAlignedElement(i));
+        queue.enqueue(OverAlignedElement(-i));
+
+        for (int expected : {i, -i})
+        {
+            const OverAlignedElement& element = queue.dequeue();
+            EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(&element) % alignof(OverAlignedElement));
+            EXPECT_EQ(expected, element.value_);
+        }
+    }
+}
+
+namespace {
+
+enum ElementId
+{
+    EMPTY_ELEMENT,
+    INT_ELEMENT,
+    STRING_ELEMENT
+};
+
+static std::atomic<int> elementCounterS(0);
+
+class ElementIf
+{
+public:
+    ElementIf() { ++elementCounterS; }
+    virtual ElementId getId() const = 0;
+    virtual ~ElementIf() { --elementCounterS; }
+};
+
+class EmptyElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = EMPTY_ELEMENT;
+    ElementId getId() const override { return ID_T; }
+};
+
+template <ElementId ID, typename DataType>
+class Element : public ElementIf
+{
+public:
+    static const ElementId ID_T = ID;
+
+    Element(const DataType& data) : data_{data} {}
+    Element(const Element& other) : data_{other.data_} {}
+    Element(Element&& other) : data_{std::move(other.data_)} {}
+    ElementId getId() const override { return ID_T; }
+    const DataType& data() const { return data_; }
+
+private:
+    DataType data_;
+};
+
+using IntElement = Element<INT_ELEMENT, int>;
+using StringElement = Element<STRING_ELEMENT, std::string>;
+
+/** Element whose construction fails */
+class ThrowingElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = EMPTY_ELEMENT;
+    explicit ThrowingElement(int) { throw std::runtime_error("construction failed"); }
+    ElementId getId() const override { return ID_T; }
+};
+
+/** Element too big for the envelope header to describe */
+class HugeElement : public ElementIf
+{
+public:
+    static const ElementId ID_T = EMPTY_ELEMENT;
+    HugeElement() = default;
+    ElementId getId() const override { return ID_T; }
+
+    char data_[size_t{1} << 32];
+};
+
+template <typename T>
+const T& element_cast(const ElementIf& element)
+{
+    assert(T::ID_T == element.getId());
+    return static_cast<const T&>(element);
+}
+
+} // anonymous namespace
+
+TEST(MultiProducerHeterogeneousQueue, ElementQueueMultipleProducers)
+{
+    const int producerCount = 4;
+    const int countPerProducer = 5000;
+
+    elementCounterS = 0;
+    {
+        MultiProducerHeterogeneousQueue<ElementIf> queue(256);
+
+        std::vector<std::thread> producers;
+        for (int p = 0; p < producerCount; ++p)
+        {
+            producers.emplace_back([&queue, countPerProducer] {
+                for (int c = 0; c < countPerProducer; ++c)
+                {
+                    queue.emplace<IntElement>(c);
+                    queue.enqueue(StringElement("Brown fox jumps over the lazy dog and does this and that"));
+                    queue.emplace<EmptyElement>();
+                }
+            });
+        }
+
+        int ints = 0;
+        int strings = 0;
+        int empties = 0;
+        for (int c = 0; c < 3 * producerCount * countPerProducer; ++c)
+        {
+            const ElementIf& element = queue.dequeue();
+            switch (element.getId())
+            {
+                case INT_ELEMENT: ++ints; break;
+                case STRING_ELEMENT:
+                    EXPECT_EQ(
+                        std::string("Brown fox jumps over the lazy dog and does this and that"),
+                        element_cast<StringElement>(element).data());
+                    ++strings;
+                    break;
+                case EMPTY_ELEMENT: ++empties; break;
+            }
+        }
+        EXPECT_EQ(producerCount * countPerProducer, ints);
+        EXPECT_EQ(producerCount * countPerProducer, strings);
+        EXPECT_EQ(producerCount * countPerProducer, empties);
+
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+
+        // Leave some elements to the queue when it's destructed
+        queue.emplace<EmptyElement>();
+        queue.emplace<IntElement>(3);
+        queue.emplace<StringElement>("Brown fox jumps over the lazy dog and does this and that");
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(MultiProducerHeterogeneousQueue, ThrowingConstructor)
+{
+    elementCounterS = 0;
+    {
+        MultiProducerHeterogeneousQueue<ElementIf> queue(256);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            queue.emplace<IntElement>(i);
+            EXPECT_THROW(queue.emplace<ThrowingElement>(i), std::runtime_error);
+            queue.emplace<IntElement>(-i);
+
+            EXPECT_FALSE(queue.isEmpty());
+            EXPECT_EQ(i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_EQ(-i, element_cast<IntElement>(queue.dequeue()).data());
+            EXPECT_TRUE(queue.isEmpty());
+            EXPECT_EQ(nullptr, queue.tryDequeue());
+        }
+
+        // Only a failed element left
+        EXPECT_THROW(queue.emplace<ThrowingElement>(0), std::runtime_error);
+        EXPECT_TRUE(queue.isEmpty());
+        EXPECT_EQ(nullptr, queue.tryDequeue());
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(MultiProducerHeterogeneousQueue, ElementTooBigForEnvelopeHeader)
+{
+    elementCounterS = 0;
+    {
+        MultiProducerHeterogeneousQueue<ElementIf> queue(256);
+
+        queue.emplace<IntElement>(1);
+        EXPECT_THROW(queue.emplace<HugeElement>(), std::length_error);
+        queue.emplace<IntElement>(2);
+
+        EXPECT_EQ(1, element_cast<IntElement>(queue.dequeue()).data());
+        EXPECT_EQ(2, element_cast<IntElement>(queue.dequeue()).data());
+        EXPECT_TRUE(queue.isEmpty());
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+TEST(MultiProducerHeterogeneousQueue, FailedBlockAllocation)
+{
+    using Queue = MultiProducerHeterogeneousQueue<ElementIf>;
+
+    bool failAllocation = false;
+    int allocationCount = 0;
+    auto allocateBuffer = [&failAllocation, &allocationCount](size_t sizeInBytes) {
+        if (failAllocation)
+            throw std::bad_alloc();
+        ++allocationCount;
+        return Queue::allocateZeroedBuffer(sizeInBytes);
+    };
+
+    elementCounterS = 0;
+    {
+        Queue queue(256, allocateBuffer);
+        EXPECT_EQ(1, allocationCount);
+
+        // Nothing is read, so each round runs out of blocks and needs a new one
+        std::vector<int> expected;
+        for (int i = 0; i < 10; ++i)
+        {
+            failAllocation = true;
+            bool allocationFailed = false;
+            for (int j = 0; j < 100000 && !allocationFailed; ++j)
+            {
+                try
+                {
+                    queue.emplace<IntElement>(j);
+                    expected.push_back(j);
+                }
+                catch (const std::bad_alloc&)
+                {
+                    allocationFailed = true;
+                }
+            }
+            ASSERT_TRUE(allocationFailed);
+
+            // Writers retry the next block, so the queue keeps growing and working
+            failAllocation = false;
+            for (int j = 0; j < 100; ++j)
+            {
+                queue.emplace<IntElement>(-j);
+                expected.push_back(-j);
+            }
+            EXPECT_LE(i + 2, allocationCount);
+        }
+
+        for (int value : expected)
+        {
+            EXPECT_EQ(value, element_cast<IntElement>(queue.dequeue()).data());
+        }
+        EXPECT_TRUE(queue.isEmpty());
+    }
+    EXPECT_EQ(0, elementCounterS);
+}
+
+} // namespace Data
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "data/ExecutorIf.hpp"
+#include <deque>
+#include <functional>
+#include <utility>
+
+namespace Data {
+
+/**
+ * Executor running the tasks only when asked to, in the calling thread.
+ * Lets tests check what was posted and control when it runs.
+ */
+class ManualExecutor : public ExecutorIf
+{
+public:
+    void post(std::function<void()> task) override { tasks_.push_back(std::move(task)); }
+
+    /** Run the queued tasks, including the ones they post */
+    void runAll()
+    {
+        while (!tasks_.empty())
+        {
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            task();
+        }
+    }
+
+    std::deque<std::function<void()>> tasks_;
+};
+
+} // namespace Data